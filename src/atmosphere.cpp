@@ -0,0 +1,397 @@
+#include "stdafx.h"
+#include "Atmosphere.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX //Keep std::min and std::max usable
+#endif
+#include <windows.h>
+#include <process.h>
+#elif defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace trajectorysim {
+
+//Binary cache of a parsed table. The header identifies the csv it was written from, and the layout of the machine that
+//wrote it, and is followed by the table's columns: altitudes, then values, then slopes
+static const char k_CacheMagic[8] = { 'T', 'S', 'A', 'T', 'M', 'O', 'S', '\0' };
+static const uint32_t k_CacheVersion = 2;
+//Any double, exactly representable, that a machine with another byte order or format would read back differently
+static const double k_CacheProbe = 1.0 / 1024 + 1024;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t double_size;
+    double probe;
+    uint64_t source_size;
+    int64_t source_time;
+    uint64_t source_checksum;
+    int64_t rows;
+    int64_t uniform;
+    double spacing;
+    double inv_spacing;
+    uint64_t checksum;
+};
+
+//FNV-1a hash of size bytes, continuing from hash
+static uint64_t Checksum(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+//Read-only view of a whole file, mapped into memory. Empty if the file can't be mapped
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& path)
+    {
+        view = nullptr;
+        length = 0;
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(file, &fileSize) && (fileSize.QuadPart > 0)) {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) {
+                view = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (view) length = (size_t)fileSize.QuadPart;
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#elif defined(__linux__)
+        int file = open(path.c_str(), O_RDONLY);
+        if (file < 0) return;
+        struct stat info;
+        if ((fstat(file, &info) == 0) && (info.st_size > 0)) {
+            void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (mapping != MAP_FAILED) {
+                view = (const char*)mapping;
+                length = info.st_size;
+            }
+        }
+        close(file);
+#endif
+    }
+
+    ~MappedFile()
+    {
+        if (!view) return;
+#if defined(_WIN32)
+        UnmapViewOfFile(view);
+#elif defined(__linux__)
+        munmap((void*)view, length);
+#endif
+    }
+
+    const char* data() const { return view; }
+    size_t size() const { return length; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char* view;
+    size_t length;
+};
+
+//Moves from over to, replacing to if it exists, in a single step so readers see either the old file or the new one
+static bool MoveIntoPlace(const std::string& from, const std::string& to) {
+#if defined(_WIN32)
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+static int ProcessId() {
+#if defined(_WIN32)
+    return _getpid();
+#elif defined(__linux__)
+    return (int)getpid();
+#else
+    return 0;
+#endif
+}
+
+//Parses the rows of an atmosphere csv: two header lines, of names and units, then an altitude and each property per line
+static std::vector<std::vector<double>> ParseAtmosphereCSV(const std::string& path) {
+    std::ifstream filestream(path, std::ios::binary);
+    if (!filestream) {
+        throw 10; //Will be caught in main()
+    }
+    std::string text((std::istreambuf_iterator<char>(filestream)), std::istreambuf_iterator<char>());
+
+    const char* p = text.c_str();
+    const char* end = p + text.size();
+    for (int header = 0; header < 2; ++header) {
+        p = (const char*)memchr(p, '\n', end - p);
+        if (!p) throw 11;
+        ++p;
+    }
+
+    std::vector<std::vector<double>> rows;
+    while (p < end) {
+        const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+        if (!lineEnd) lineEnd = end;
+        //Values are read in place, without copying out each field
+        std::vector<double> row;
+        while (p < lineEnd) {
+            while ((p < lineEnd) && ((*p == ' ') || (*p == '\t') || (*p == '\r'))) ++p;
+            if ((p == lineEnd) && row.empty()) break; //Blank line
+            char* next;
+            double value = strtod(p, &next);
+            if ((next == p) || (next > lineEnd)) throw 11;
+            row.push_back(value);
+            p = next;
+            while ((p < lineEnd) && ((*p == ' ') || (*p == '\t') || (*p == '\r'))) ++p;
+            if (p == lineEnd) break;
+            if (*p != ',') throw 11;
+            ++p;
+            if (p == lineEnd) throw 11;
+        }
+        p = lineEnd + 1;
+        if (row.empty()) continue;
+        if (row.size() != 1 + AtmosphereTable::k_PropertyCount) throw 11;
+        if (!rows.empty() && !(row[0] > rows.back()[0])) throw 11;
+        rows.push_back(row);
+    }
+    if (rows.empty()) throw 11;
+    return rows;
+}
+
+AtmosphereTable::AtmosphereTable()
+{
+    rows = 0;
+    uniform = false;
+    spacing = 0;
+    inv_spacing = 0;
+}
+
+AtmosphereTable::AtmosphereTable(const std::vector<std::vector<double>>& rows)
+{
+    AtmosphereTable::rows = (int)rows.size();
+    altitudes.resize(rows.size());
+    values.resize(k_PropertyCount * rows.size());
+    slopes.resize(k_PropertyCount * rows.size(), 0.0);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        altitudes[i] = rows[i][0];
+        for (int property = 0; property < k_PropertyCount; ++property) {
+            size_t index = property * rows.size() + i;
+            values[index] = rows[i][property + 1];
+            //The last interval is left flat, holding the top row
+            if (i + 1 < rows.size()) slopes[index] = (rows[i + 1][property + 1] - rows[i][property + 1]) / (rows[i + 1][0] - rows[i][0]);
+        }
+    }
+
+    //Evenly spaced tables find the interval from the altitude directly
+    uniform = rows.size() >= 2;
+    spacing = uniform ? altitudes[1] - altitudes[0] : 0;
+    uniform = uniform && (spacing > 0);
+    for (size_t i = 1; uniform && (i < rows.size()); ++i) {
+        double expected = altitudes[0] + i * spacing;
+        if (std::abs(altitudes[i] - expected) > 1e-9 * std::abs(expected) + 1e-9) uniform = false;
+    }
+    if (!uniform) spacing = 0;
+    inv_spacing = uniform ? 1 / spacing : 0;
+}
+
+const AtmosphereTable& AtmosphereTable::load(const std::string& path) {
+    //Tables loaded so far, by path. Never freed, so the references returned stay valid for the life of the process
+    static std::mutex mutex;
+    static std::map<std::string, std::unique_ptr<AtmosphereTable>> loaded;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<AtmosphereTable>& table = loaded[path];
+    if (!table) {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) {
+            throw 10; //Will be caught in main()
+        }
+        uint64_t source_size = (uint64_t)info.st_size;
+        int64_t source_time = (int64_t)info.st_mtime;
+        //The modification time only has whole seconds, so an edit within the second the cache was written from keeps
+        //it. Hashing the csv costs far less than parsing it, and catches any edit
+        uint64_t source_checksum;
+        {
+            MappedFile source(path);
+            source_checksum = Checksum(source.data(), source.size());
+        }
+        std::string cachePath = path + ".cache";
+        std::unique_ptr<AtmosphereTable> fresh(new AtmosphereTable());
+        if (!fresh->readCache(cachePath, source_size, source_time, source_checksum)) {
+            *fresh = AtmosphereTable(ParseAtmosphereCSV(path));
+            fresh->writeCache(cachePath, source_size, source_time, source_checksum);
+        }
+        table = std::move(fresh);
+    }
+    return *table;
+}
+
+bool AtmosphereTable::readCache(const std::string& path, uint64_t source_size, int64_t source_time, uint64_t source_checksum) {
+    MappedFile file(path);
+    if (file.size() < sizeof(CacheHeader)) return false;
+    CacheHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, k_CacheMagic, sizeof(k_CacheMagic)) != 0) return false;
+    if ((header.version != k_CacheVersion) || (header.double_size != sizeof(double)) || (header.probe != k_CacheProbe)) return false;
+    if ((header.source_size != source_size) || (header.source_time != source_time) || (header.source_checksum != source_checksum)) return false;
+
+    size_t payload = file.size() - sizeof(CacheHeader);
+    size_t rowBytes = (1 + 2 * k_PropertyCount) * sizeof(double);
+    if ((header.rows <= 0) || ((uint64_t)header.rows > payload / rowBytes) || ((size_t)header.rows * rowBytes != payload)) return false;
+    const char* columns = file.data() + sizeof(CacheHeader);
+    if (Checksum(columns, payload) != header.checksum) return false;
+
+    rows = (int)header.rows;
+    uniform = header.uniform != 0;
+    spacing = header.spacing;
+    inv_spacing = header.inv_spacing;
+    const double* data = (const double*)columns;
+    altitudes.assign(data, data + rows);
+    data += rows;
+    values.assign(data, data + k_PropertyCount * rows);
+    data += k_PropertyCount * rows;
+    slopes.assign(data, data + k_PropertyCount * rows);
+    return true;
+}
+
+void AtmosphereTable::writeCache(const std::string& path, uint64_t source_size, int64_t source_time, uint64_t source_checksum) const {
+#if defined(_WIN32) || defined(__linux__)
+    CacheHeader header;
+    memcpy(header.magic, k_CacheMagic, sizeof(k_CacheMagic));
+    header.version = k_CacheVersion;
+    header.double_size = sizeof(double);
+    header.probe = k_CacheProbe;
+    header.source_size = source_size;
+    header.source_time = source_time;
+    header.source_checksum = source_checksum;
+    header.rows = rows;
+    header.uniform = uniform ? 1 : 0;
+    header.spacing = spacing;
+    header.inv_spacing = inv_spacing;
+    header.checksum = Checksum(altitudes.data(), altitudes.size() * sizeof(double));
+    header.checksum = Checksum(values.data(), values.size() * sizeof(double), header.checksum);
+    header.checksum = Checksum(slopes.data(), slopes.size() * sizeof(double), header.checksum);
+
+    //Written to a file of this process's own, then moved into place, so processes starting together never map a
+    //partly written cache
+    std::string temporary = path + "." + std::to_string(ProcessId()) + ".tmp";
+    bool written;
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file) return; //Not writable, so later processes parse the csv too
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)altitudes.data(), altitudes.size() * sizeof(double));
+        file.write((const char*)values.data(), values.size() * sizeof(double));
+        file.write((const char*)slopes.data(), slopes.size() * sizeof(double));
+        file.close();
+        written = !file.fail();
+    }
+    if (!written || !MoveIntoPlace(temporary, path)) std::remove(temporary.c_str());
+#endif
+}
+
+AtmosphereProperties AtmosphereTable::lookup(double altitude) const {
+    int hint = -1;
+    return lookup(altitude, hint);
+}
+
+AtmosphereProperties AtmosphereTable::lookup(double altitude, int& hint) const {
+    double offset;
+    int interval = locate(altitude, hint, offset);
+    return AtmosphereProperties{
+        evaluate(k_Temp, interval, offset),
+        evaluate(k_Press, interval, offset),
+        evaluate(k_Density, interval, offset),
+        evaluate(k_SpeedOfSound, interval, offset),
+        evaluate(k_DynViscosity, interval, offset)
+    };
+}
+
+int AtmosphereTable::locate(double altitude, int& hint, double& offset) const {
+    int interval;
+    if (uniform) {
+        //max and min in this order, so a NaN altitude is held at the bottom row rather than indexing out of the table
+        interval = (int)std::min(std::max(0.0, std::floor((altitude - altitudes[0]) * inv_spacing)), (double)(rows - 1));
+        offset = std::max(altitude - (altitudes[0] + interval * spacing), 0.0);
+    }
+    else {
+        interval = hunt(altitude, hint);
+        hint = interval;
+        offset = std::max(altitude - altitudes[interval], 0.0);
+    }
+    return interval;
+}
+
+int AtmosphereTable::hunt(double altitude, int hint) const {
+    if (!(altitude >= altitudes[0])) return 0;
+    //Bracket altitude between altitudes[low] and altitudes[high], doubling the step away from hint, then bisect
+    int low = 0;
+    int high = rows;
+    if ((hint >= 0) && (hint < rows)) {
+        int step = 1;
+        if (altitudes[hint] <= altitude) {
+            low = hint;
+            high = hint + 1;
+            while ((high < rows) && (altitudes[high] <= altitude)) {
+                low = high;
+                step *= 2;
+                high = low + step;
+            }
+            high = std::min(high, rows);
+        }
+        else {
+            high = hint;
+            low = hint - 1;
+            while ((low > 0) && (altitudes[low] > altitude)) {
+                high = low;
+                step *= 2;
+                low = high - step;
+            }
+            low = std::max(low, 0);
+        }
+    }
+    while (high - low > 1) {
+        int middle = (low + high) / 2;
+        if (altitudes[middle] <= altitude) low = middle;
+        else high = middle;
+    }
+    return low;
+}
+
+void AtmosphereTable::VectorLookup::hunt(simd::Vec altitude, int* hints, simd::Vec& interval, simd::Vec& offset) const {
+    double lanes[simd::k_Width];
+    simd::store(lanes, altitude);
+    for (int i = 0; i < simd::k_Width; ++i) {
+        hints[i] = table.hunt(lanes[i], hints[i]);
+        lanes[i] = hints[i];
+    }
+    interval = simd::load(lanes);
+    offset = simd::max(altitude - simd::gather(altitudes, interval), simd::set1(0.0));
+}
+
+bool AtmosphereTable::isUniform() const { return uniform; }
+
+double AtmosphereTable::getTopAltitude() const { return altitudes.back(); }
+
+int AtmosphereTable::size() const { return rows; }
+} // namespace trajectorysim
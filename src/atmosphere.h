@@ -0,0 +1,155 @@
+#pragma once
+// atmosphere.h : Atmosphere properties tabulated against altitude, linearly interpolated. The table is held as
+// structure-of-arrays, one contiguous column per property, with the slope of each interval precomputed, so a lookup is
+// one interval search and one multiply-add per property. Evenly spaced tables, like atmosphere.csv, find the interval
+// directly from the altitude, with no search or branches, and can be looked up for simd::k_Width altitudes at a time.
+#include "simd.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace trajectorysim {
+
+struct AtmosphereProperties {
+    double temp;
+    double press;
+    double density;
+    double speed_of_sound;
+    double dyn_viscosity;
+};
+
+class AtmosphereTable
+{
+public:
+    // Columns of the table, in the order of AtmosphereProperties
+    enum Property { k_Temp, k_Press, k_Density, k_SpeedOfSound, k_DynViscosity, k_PropertyCount };
+
+    AtmosphereTable();
+
+    // rows hold an altitude, in ascending order, followed by each property at that altitude
+    explicit AtmosphereTable(const std::vector<std::vector<double>>& rows);
+
+    // Returns the table in the csv at path, loaded once per process and shared, read-only, by every call after.
+    // Loads from path's binary cache, [path].cache, if it was written from the csv as it is now, by its size,
+    // modification time and checksum. Otherwise parses the csv and writes the cache for later processes. Throws 10 if
+    // the csv can't be read, and 11 if it's malformed
+    static const AtmosphereTable& load(const std::string& path);
+
+    // Returns every property at altitude. Below and above the table, the end rows are held
+    AtmosphereProperties lookup(double altitude) const;
+
+    // As above, starting the search for altitude's interval from hint, which is updated to the interval found. Hunts
+    // outwards from hint, so is cheap when successive altitudes are close. Only tables that aren't evenly spaced search
+    AtmosphereProperties lookup(double altitude, int& hint) const;
+
+    // Returns the interval of the table altitude lies in, and sets offset to the altitude above the interval's start.
+    // The last interval starts at the top row and has zero slope, which holds the top row above the table
+    int locate(double altitude, int& hint, double& offset) const;
+
+    // Returns property at offset into interval
+    double evaluate(Property property, int interval, double offset) const;
+
+    // Looks up the table for simd::k_Width altitudes at a time. Holds the table's constants ready in vectors, and its
+    // columns' addresses, so make one before a loop over lanes, where they can stay in registers
+    class VectorLookup
+    {
+    public:
+        explicit VectorLookup(const AtmosphereTable& table);
+
+        // Vector forms of locate and evaluate. hints holds one hint per lane, and is only used if the table isn't
+        // evenly spaced
+        void locate(simd::Vec altitude, int* hints, simd::Vec& interval, simd::Vec& offset) const;
+        simd::Vec evaluate(Property property, simd::Vec interval, simd::Vec offset) const;
+
+        // Sets properties, one vector per property in the order of Property
+        void lookup(simd::Vec altitude, int* hints, simd::Vec* properties) const;
+
+    private:
+        // locate() for tables that aren't evenly spaced. Out of line, to keep the search out of the callers' loops
+        void hunt(simd::Vec altitude, int* hints, simd::Vec& interval, simd::Vec& offset) const;
+
+        const AtmosphereTable& table;
+        bool uniform;
+        simd::Vec base_alt;
+        simd::Vec spacing;
+        simd::Vec inv_spacing;
+        simd::Vec last_interval;
+        int rows;
+        const double* altitudes;
+        const double* values;
+        const double* slopes;
+    };
+
+    // Returns true if the table's altitudes are evenly spaced
+    bool isUniform() const;
+
+    // Returns the altitude of the top row
+    double getTopAltitude() const;
+
+    int size() const;
+
+private:
+    // Returns the interval altitude lies in, for tables that aren't evenly spaced
+    int hunt(double altitude, int hint) const;
+
+    // Reads the table from the binary cache at path, mapping it into memory. Returns false, leaving the table
+    // unchanged, if there is no cache, or it's corrupt or was written from a csv of another size, modification time
+    // or checksum
+    bool readCache(const std::string& path, uint64_t source_size, int64_t source_time, uint64_t source_checksum);
+
+    // Writes the table as the binary cache at path, if path's directory is writable
+    void writeCache(const std::string& path, uint64_t source_size, int64_t source_time, uint64_t source_checksum) const;
+
+    int rows;
+    bool uniform;
+    double spacing;
+    double inv_spacing;
+    std::vector<double> altitudes;
+    // Value at the start and slope of each interval, property by property, each property's column rows long
+    std::vector<double> values;
+    std::vector<double> slopes;
+};
+
+inline double AtmosphereTable::evaluate(Property property, int interval, double offset) const {
+    size_t index = (size_t)property * rows + interval;
+    return values[index] + slopes[index] * offset;
+}
+
+inline AtmosphereTable::VectorLookup::VectorLookup(const AtmosphereTable& table)
+    : table(table)
+{
+    uniform = table.uniform;
+    base_alt = simd::set1(table.altitudes[0]);
+    spacing = simd::set1(table.spacing);
+    inv_spacing = simd::set1(table.inv_spacing);
+    last_interval = simd::set1(table.rows - 1);
+    rows = table.rows;
+    altitudes = table.altitudes.data();
+    values = table.values.data();
+    slopes = table.slopes.data();
+}
+
+inline void AtmosphereTable::VectorLookup::locate(simd::Vec altitude, int* hints, simd::Vec& interval, simd::Vec& offset) const {
+    using namespace simd;
+    if (!uniform) {
+        hunt(altitude, hints, interval, offset);
+        return;
+    }
+    const Vec zero = set1(0.0);
+    interval = min(max(floor((altitude - base_alt) * inv_spacing), zero), last_interval);
+    offset = max(altitude - fmadd(interval, spacing, base_alt), zero);
+}
+
+inline simd::Vec AtmosphereTable::VectorLookup::evaluate(Property property, simd::Vec interval, simd::Vec offset) const {
+    size_t column = (size_t)property * rows;
+    return simd::fmadd(simd::gather(slopes + column, interval), offset, simd::gather(values + column, interval));
+}
+
+inline void AtmosphereTable::VectorLookup::lookup(simd::Vec altitude, int* hints, simd::Vec* properties) const {
+    simd::Vec interval, offset;
+    locate(altitude, hints, interval, offset);
+    for (int property = 0; property < k_PropertyCount; ++property) {
+        properties[property] = evaluate((Property)property, interval, offset);
+    }
+}
+} // namespace trajectorysim
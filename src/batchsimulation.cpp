@@ -0,0 +1,233 @@
+#include "stdafx.h"
+#include "BatchSimulation.h"
+#include "EventLocation.h"
+#include "Geodetic.h"
+#include "simd.h"
+#include <cmath>
+
+namespace trajectorysim {
+
+BatchSimulation::BatchSimulation(const Earth& earth, double dT, RunLimits limits)
+    : earth(earth)
+{
+    BatchSimulation::dT = dT;
+    BatchSimulation::limits = limits;
+    lanes = 0;
+    active_lane_steps = 0;
+    vector_lane_steps = 0;
+}
+
+int BatchSimulation::addRun(Projectile* projectile, int run_num) {
+    int lane = lanes;
+    if (lane >= (int)pos_x.size()) {
+        //Grow by a whole vector. Padding lanes sit at zero altitude, so never step
+        size_t capacity = pos_x.size() + simd::k_Width;
+        for (std::vector<double>* column : { &pos_x, &pos_y, &pos_z, &vel_x, &vel_y, &vel_z, &altitude, &area,
+                                             &Cd_subsonic, &Cd_supersonic, &time, &steps, &leaving }) {
+            column->resize(capacity, 0.0);
+        }
+        mass.resize(capacity, 1.0);
+        BatchSimulation::run_num.resize(capacity, 0);
+        atmosphere_hint.resize(capacity, -1);
+        status.resize(capacity, k_Impact);
+        properties.resize(capacity);
+        initvel.resize(capacity, Earth::Coords{ 0.0, 0.0, 0.0 });
+    }
+
+    ++lanes;
+    setRun(lane, projectile, run_num);
+    return lane;
+}
+
+void BatchSimulation::setRun(int lane, Projectile* projectile, int run_num) {
+    Earth::Coords pos = projectile->GetPos();
+    Earth::Coords vel = projectile->GetVel();
+    pos_x[lane] = pos.x;
+    pos_y[lane] = pos.y;
+    pos_z[lane] = pos.z;
+    vel_x[lane] = vel.x;
+    vel_y[lane] = vel.y;
+    vel_z[lane] = vel.z;
+    altitude[lane] = projectile->getAltitude();
+    mass[lane] = projectile->getMass();
+    area[lane] = projectile->getFrontalArea();
+    Cd_subsonic[lane] = projectile->getDragCoeff(true);
+    Cd_supersonic[lane] = projectile->getDragCoeff(false);
+    time[lane] = 0;
+    steps[lane] = 0;
+    BatchSimulation::run_num[lane] = run_num;
+    properties[lane] = projectile->getProperties();
+    initvel[lane] = vel;
+    leaving[lane] = 0;
+    status[lane] = k_Impact;
+
+    //Checked before the first step, as Simulation does
+    if ((altitude[lane] <= 0) || (limits.max_steps <= 0)) finished.push_back(lane);
+    else if (stopIfLeaving(lane)) finished.push_back(lane);
+}
+
+bool BatchSimulation::stopIfLeaving(int lane) {
+    RunStatus leavingStatus = Simulation::classifyLeaving(Earth::Coords{ pos_x[lane], pos_y[lane], pos_z[lane] },
+        Earth::Coords{ vel_x[lane], vel_y[lane], vel_z[lane] }, altitude[lane], limits, earth.atmosphere.getTopAltitude());
+    if (leavingStatus == k_Impact) return false;
+    leaving[lane] = 1;
+    status[lane] = leavingStatus;
+    return true;
+}
+
+void BatchSimulation::clear() {
+    //Keep the arrays allocated, but park every lane
+    for (size_t lane = 0; lane < altitude.size(); ++lane) altitude[lane] = 0;
+    lanes = 0;
+    finished.clear();
+}
+
+int BatchSimulation::size() { return lanes; }
+
+int BatchSimulation::getRunNum(int lane) { return run_num[lane]; }
+
+bool BatchSimulation::step() {
+    using namespace simd;
+    const Vec zero = set1(0.0);
+    const Vec half = set1(0.5);
+    const Vec v_dT = set1(dT);
+    const Vec v_half_dT2 = set1(0.5 * dT * dT);
+    const Vec v_maxSteps = set1(limits.max_steps);
+    const Vec v_atmosphere_top = set1(earth.atmosphere.getTopAltitude());
+    //Below the lowest radius a perigee clear of the atmosphere can have, the polar radius, by a margin for rounding
+    const Vec v_inv_perigee_floor = set1(1.0 / (0.99 * (Earth::a * (1 - Earth::f) + earth.atmosphere.getTopAltitude())));
+    const Vec v_a = set1(Earth::a);
+    const Vec v_grav_const = set1(Earth::grav_const);
+    const AtmosphereTable::VectorLookup atmosphere(earth.atmosphere);
+
+    bool running = false;
+    for (int lane = 0; lane < lanes; lane += k_Width) {
+        Vec alt = load(&altitude[lane]);
+        Vec stepCount = load(&steps[lane]);
+        Mask active = (alt > zero) & (stepCount < v_maxSteps) & (load(&leaving[lane]) < half);
+        if (!any(active)) continue;
+        running = true;
+        active_lane_steps += count(active);
+        vector_lane_steps += k_Width;
+
+        //Atmosphere, interpolated within the interval below each altitude. Outside the table, the end values are held
+        Vec interval, offset;
+        atmosphere.locate(alt, &atmosphere_hint[lane], interval, offset);
+        Vec density = atmosphere.evaluate(AtmosphereTable::k_Density, interval, offset);
+        Vec sos = atmosphere.evaluate(AtmosphereTable::k_SpeedOfSound, interval, offset);
+
+        Vec px = load(&pos_x[lane]), py = load(&pos_y[lane]), pz = load(&pos_z[lane]);
+        Vec vx = load(&vel_x[lane]), vy = load(&vel_y[lane]), vz = load(&vel_z[lane]);
+
+        //Drag, opposing velocity: a = -(Cd * A * rho * |v|^2 / 2) / m * v / |v|
+        Vec vel_mag = sqrt(fmadd(vx, vx, fmadd(vy, vy, vz * vz)));
+        Vec Cd = select(sos > vel_mag, load(&Cd_subsonic[lane]), load(&Cd_supersonic[lane]));
+        Vec drag = zero - Cd * load(&area[lane]) * density * vel_mag * half / load(&mass[lane]);
+
+        //Gravity, towards the centre of the earth, falling off with altitude
+        Vec pos_mag = sqrt(fmadd(px, px, fmadd(py, py, pz * pz)));
+        Vec ratio = v_a / (v_a + alt);
+        Vec grav = v_grav_const * ratio * ratio / pos_mag;
+
+        Vec ax = fmadd(drag, vx, grav * px);
+        Vec ay = fmadd(drag, vy, grav * py);
+        Vec az = fmadd(drag, vz, grav * pz);
+
+        //Constant acceleration update, as in Projectile::updatePosition
+        Vec new_px = fmadd(ax, v_half_dT2, fmadd(vx, v_dT, px));
+        Vec new_py = fmadd(ay, v_half_dT2, fmadd(vy, v_dT, py));
+        Vec new_pz = fmadd(az, v_half_dT2, fmadd(vz, v_dT, pz));
+        Vec new_alt = geodeticAltitude(new_px, new_py, new_pz);
+
+        store(&pos_x[lane], select(active, new_px, px));
+        store(&pos_y[lane], select(active, new_py, py));
+        store(&pos_z[lane], select(active, new_pz, pz));
+        store(&vel_x[lane], select(active, fmadd(ax, v_dT, vx), vx));
+        store(&vel_y[lane], select(active, fmadd(ay, v_dT, vy), vy));
+        store(&vel_z[lane], select(active, fmadd(az, v_dT, vz), vz));
+        store(&altitude[lane], select(active, new_alt, alt));
+        Vec t = load(&time[lane]);
+        Vec new_stepCount = stepCount + set1(1.0);
+        store(&time[lane], select(active, t + v_dT, t));
+        store(&steps[lane], select(active, new_stepCount, stepCount));
+
+        //Queue the lanes whose runs ended this step to be retired
+        int ended = bits(andnot(active, (new_alt > zero) & (new_stepCount < v_maxSteps)));
+        if (ended != 0) {
+            double start[6][k_Width], accel[3][k_Width], start_alt[k_Width];
+            store(start[0], px); store(start[1], py); store(start[2], pz);
+            store(start[3], vx); store(start[4], vy); store(start[5], vz);
+            store(accel[0], ax); store(accel[1], ay); store(accel[2], az);
+            store(start_alt, alt);
+            for (int i = 0; ended != 0; ++i, ended >>= 1) {
+                if (!(ended & 1)) continue;
+                int runLane = lane + i;
+                if (altitude[runLane] <= 0) {
+                    //Impact, somewhere within this step. Move back to where the path crosses the ground
+                    ConstantAccelPath path(State{ Earth::Coords{ start[0][i], start[1][i], start[2][i] }, Earth::Coords{ start[3][i], start[4][i], start[5][i] } },
+                                           Earth::Coords{ accel[0][i], accel[1][i], accel[2][i] });
+                    double t = locateImpact(path, dT, start_alt[i], altitude[runLane]);
+                    State impact = path.at(t);
+                    pos_x[runLane] = impact.pos.x;
+                    pos_y[runLane] = impact.pos.y;
+                    pos_z[runLane] = impact.pos.z;
+                    vel_x[runLane] = impact.vel.x;
+                    vel_y[runLane] = impact.vel.y;
+                    vel_z[runLane] = impact.vel.z;
+                    altitude[runLane] = Earth::ECEFToAlt(impact.pos);
+                    time[runLane] += t - dT;
+                }
+                finished.push_back(runLane);
+            }
+        }
+
+        //Runs still going that may be leaving, to be classified as Simulation does. Only runs above the atmosphere with
+        //the energy for a semi-major axis, which is above the perigee, clear of it can be. From the step's start, as
+        //the energy barely changes over a step: v^2 / 2 - |g| * r > -|g| * r^2 / (2 * floor), with mu = |g| * r^2
+        Vec g_r = zero - grav * pos_mag * pos_mag;
+        int candidates = bits(active & (new_alt > v_atmosphere_top) & (new_stepCount < v_maxSteps) &
+                              (vel_mag * vel_mag > g_r * (set1(2.0) - pos_mag * v_inv_perigee_floor)));
+        for (int i = 0; candidates != 0; ++i, candidates >>= 1) {
+            if ((candidates & 1) && stopIfLeaving(lane + i)) finished.push_back(lane + i);
+        }
+    }
+    return running;
+}
+
+bool BatchSimulation::popFinished(int& lane) {
+    if (finished.empty()) return false;
+    lane = finished.back();
+    finished.pop_back();
+    return true;
+}
+
+long long BatchSimulation::getActiveLaneSteps() { return active_lane_steps; }
+long long BatchSimulation::getVectorLaneSteps() { return vector_lane_steps; }
+
+void BatchSimulation::run() {
+    while (step()) {}
+}
+
+SolutionRecord BatchSimulation::getSolution(int lane) {
+    return SolutionRecord{
+        run_num[lane],
+        dT,
+        time[lane],
+        Earth::Coords{ pos_x[lane], pos_y[lane], pos_z[lane] },
+        altitude[lane],
+        properties[lane],
+        Cd_subsonic[lane],
+        Cd_supersonic[lane],
+        initvel[lane],
+        (int)steps[lane],
+        0,
+        -1,
+        -1,
+        Earth::Coords{ 0, 0, 0 },
+        0,
+        -1,
+        leaving[lane] > 0 ? status[lane] : (altitude[lane] <= 0 ? k_Impact : k_StepLimit),
+        {}
+    };
+}
+} // namespace trajectorysim
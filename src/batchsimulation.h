@@ -0,0 +1,86 @@
+#pragma once
+#include "Earth.h"
+#include "Projectile.h"
+#include "Simulation.h"
+#include <string>
+#include <vector>
+
+namespace trajectorysim {
+
+// Propagates a batch of runs in lockstep. Run state is held as structure-of-arrays, one lane per run, and each step
+// evaluates the atmosphere lookup, drag, gravity and position update for simd::k_Width lanes at a time. Uses the
+// same force models and update as Simulation, without per-step virtual calls or transcendental functions, so results
+// agree with Simulation to rounding error. Does not produce per-step output.
+class BatchSimulation
+{
+public:
+    // earth provides the atmosphere model, and is only read from, so may be shared between batches on different threads
+    // dT is the simulation time step in secs
+    // limits stop each run as Simulation's do, except for max_wall_time, which batches ignore
+    BatchSimulation(const Earth& earth, double dT, RunLimits limits = RunLimits::defaults());
+
+    // Adds a run to the batch in a new lane, copying the projectile's current state and properties. Returns the run's lane
+    int addRun(Projectile* projectile, int run_num);
+
+    // Replaces the run in lane with a new one. Used to refill the lanes of finished runs, so the batch keeps
+    // every vector lane busy while there are runs left to start
+    void setRun(int lane, Projectile* projectile, int run_num);
+
+    // Removes all runs from the batch
+    void clear();
+
+    // Returns the number of lanes in the batch
+    int size();
+
+    // Advances every unfinished run one step. Returns false once every run has hit the ground or the step limit, or
+    // been found to be leaving by Simulation::classifyLeaving
+    bool step();
+
+    // Takes the next lane whose run has finished since it was last checked, returning false if there are none.
+    // Runs that start on or below the ground are reported as soon as they are added
+    bool popFinished(int& lane);
+
+    // Number of lane steps that advanced an unfinished run, and number of lane steps processed in total.
+    // Their ratio is the vector occupancy of the batch
+    long long getActiveLaneSteps();
+    long long getVectorLaneSteps();
+
+    // Steps until every run has finished
+    void run();
+
+    // Returns the sim results of the run in lane
+    SolutionRecord getSolution(int lane);
+
+    // Returns the number of the run in lane
+    int getRunNum(int lane);
+
+private:
+    // Stops lane's run if Simulation::classifyLeaving finds it won't come back down, returning true if it did
+    bool stopIfLeaving(int lane);
+
+    const Earth& earth;
+    double dT;
+    RunLimits limits;
+    int lanes;
+
+    // Per-lane run state. Arrays are padded to a whole number of simd::k_Width lanes
+    std::vector<double> pos_x, pos_y, pos_z;
+    std::vector<double> vel_x, vel_y, vel_z;
+    std::vector<double> altitude;
+    std::vector<double> mass, area, Cd_subsonic, Cd_supersonic;
+    std::vector<double> time, steps;
+    // 1 once a lane's run has been stopped as leaving, with its status in status, so the lane is no longer stepped.
+    // Held as a double to be tested alongside the other columns
+    std::vector<double> leaving;
+    std::vector<RunStatus> status;
+    // Interval of the atmosphere table each lane was last in, to start its search from if the table isn't evenly spaced
+    std::vector<int> atmosphere_hint;
+    std::vector<int> run_num;
+    std::vector<std::string> properties;
+    std::vector<Earth::Coords> initvel;
+
+    std::vector<int> finished;
+    long long active_lane_steps;
+    long long vector_lane_steps;
+};
+} // namespace trajectorysim
@@ -0,0 +1,343 @@
+#include "stdafx.h"
+#include "Campaign.h"
+#include "BatchSimulation.h"
+#include "Scheduler.h"
+#include "Dispersion.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace trajectorysim {
+
+CaseGenerator::CaseGenerator(RunParms nominal, RunParms stdDeviation, DispersionFlags flags, uint64_t seed)
+{
+    CaseGenerator::nominal = nominal;
+    CaseGenerator::stdDeviation = stdDeviation;
+    CaseGenerator::flags = flags;
+    CaseGenerator::seed = seed;
+}
+
+uint64_t CaseGenerator::getSeed() const { return seed; }
+
+RunCase CaseGenerator::makeCase(int run_num) const {
+    RunParms runParms = nominal;
+
+    if (flags.pos) {
+        RandomStream rng(seed, run_num, Dispersion::k_Position);
+        runParms.pos_LLA = Dispersion::Disperse3DVector(rng, nominal.pos_LLA, stdDeviation.pos_LLA);
+    }
+    if (flags.vel) {
+        RandomStream rng(seed, run_num, Dispersion::k_Velocity);
+        runParms.vel_ECEF = Dispersion::Disperse3DVector(rng, nominal.vel_ECEF, stdDeviation.vel_ECEF);
+    }
+    if (flags.mass) {
+        RandomStream rng(seed, run_num, Dispersion::k_Mass);
+        runParms.mass = Dispersion::DisperseInput(rng, nominal.mass, stdDeviation.mass, false);
+    }
+    if (flags.length) {
+        RandomStream rng(seed, run_num, Dispersion::k_Length);
+        runParms.length = Dispersion::DisperseInput(rng, nominal.length, stdDeviation.length, false);
+    }
+    if (flags.diameter) {
+        RandomStream rng(seed, run_num, Dispersion::k_Diameter);
+        runParms.diameter = Dispersion::DisperseInput(rng, nominal.diameter, stdDeviation.diameter, false);
+    }
+    if (flags.impulse) {
+        RandomStream rng(seed, run_num, Dispersion::k_Impulse);
+        runParms.impulse = Dispersion::DisperseInput(rng, nominal.impulse, stdDeviation.impulse);
+    }
+    if (flags.Cd_subsonic) {
+        RandomStream rng(seed, run_num, Dispersion::k_CdSubsonic);
+        runParms.Cd_subsonic = Dispersion::DisperseInput(rng, nominal.Cd_subsonic, stdDeviation.Cd_subsonic, false);
+    }
+    if (flags.Cd_supersonic) {
+        RandomStream rng(seed, run_num, Dispersion::k_CdSupersonic);
+        runParms.Cd_supersonic = Dispersion::DisperseInput(rng, nominal.Cd_supersonic, stdDeviation.Cd_supersonic, false);
+    }
+
+    RandomStream impulse_rng(seed, run_num, Dispersion::k_ImpulseDirection);
+    Earth::Coords impulseUnitVector = Dispersion::Random3DUnitVector(impulse_rng);
+    return RunCase{ run_num, runParms, impulseUnitVector };
+}
+
+RunCase CaseGenerator::makeNominalCase() const {
+    RandomStream impulse_rng(seed, 0, Dispersion::k_ImpulseDirection);
+    return RunCase{ 0, nominal, Dispersion::Random3DUnitVector(impulse_rng) };
+}
+
+Campaign::Campaign(const Earth& earth, CampaignSettings settings)
+    : earth(earth), abort(false), cancelled(false), active_lane_steps(0), vector_lane_steps(0)
+{
+    Campaign::settings = settings;
+    active_writer = nullptr;
+    statistics = StatisticsNode::empty();
+    if (Campaign::settings.threads <= 0) {
+        Campaign::settings.threads = std::thread::hardware_concurrency();
+        if (Campaign::settings.threads <= 0) Campaign::settings.threads = 1;
+    }
+    if (Campaign::settings.fulloutput || (Campaign::settings.batch < 0) || (Campaign::settings.richardson_order > 0) ||
+        (Campaign::settings.coast_alt >= 0) || Campaign::settings.flat_earth.enabled || !Campaign::settings.gates.empty() ||
+        (Campaign::settings.integrator.type != IntegratorSettings::k_ConstantAccel) || !Campaign::settings.forces.isDefault()) {
+        Campaign::settings.batch = 0;
+    }
+}
+
+int Campaign::getThreadCount() { return settings.threads; }
+
+void Campaign::setResultCallback(ResultCallback callback) {
+    result_callback = callback;
+}
+
+void Campaign::cancel() {
+    cancelled = true;
+    abort = true;
+}
+
+bool Campaign::isCancelled() { return cancelled; }
+
+StatisticsNode Campaign::getStatistics() {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    return active_writer ? active_writer->getStatistics() : statistics;
+}
+
+bool Campaign::isValidShape(const std::string& shape) {
+    return (shape == "cylinder") || (shape == "sphere");
+}
+
+std::unique_ptr<Projectile> Campaign::makeProjectile(const RunCase& runCase) {
+    const RunParms& runParms = runCase.parms;
+    Earth::Coords newVel{
+        runParms.vel_ECEF.x + runParms.impulse * runCase.impulse_dir.x,
+        runParms.vel_ECEF.y + runParms.impulse * runCase.impulse_dir.y,
+        runParms.vel_ECEF.z + runParms.impulse * runCase.impulse_dir.z,
+    };
+    Earth::Coords Pos_ECEF = Earth::LatLonAltToECEF(runParms.pos_LLA);
+    if (runParms.shape == "cylinder") {
+        return std::unique_ptr<Projectile>(new Cylinder(Pos_ECEF, newVel, runParms.mass, runParms.diameter, runParms.length, runParms.Cd_subsonic, runParms.Cd_supersonic));
+    }
+    else if (runParms.shape == "sphere") {
+        return std::unique_ptr<Projectile>(new Sphere(Pos_ECEF, newVel, runParms.mass, runParms.diameter, runParms.Cd_subsonic, runParms.Cd_supersonic));
+    }
+    return nullptr;
+}
+
+double Campaign::predictDuration(const RunCase& runCase) {
+    //Vacuum fall time from the initial altitude and vertical speed. Ignores drag, but only needs to rank runs
+    std::unique_ptr<Projectile> projectile = makeProjectile(runCase);
+    if (!projectile) return 0;
+    Earth::Coords pos = projectile->GetPos();
+    Earth::Coords vel = projectile->GetVel();
+    double altitude = projectile->getAltitude();
+    if (altitude <= 0) return 0;
+    double vertical_vel = (pos.x * vel.x + pos.y * vel.y + pos.z * vel.z) / projectile->GetPosMag();
+    double g = -Earth::getGravity(altitude);
+    return (vertical_vel + sqrt(vertical_vel * vertical_vel + 2 * g * altitude)) / g;
+}
+
+void Campaign::run(const CaseGenerator& generator, int firstRun, int endRun) {
+    size_t caseCount = endRun > firstRun ? endRun - firstRun : 0;
+    abort = cancelled.load();
+    error = nullptr;
+    active_lane_steps = 0;
+    vector_lane_steps = 0;
+
+    int threadCount = settings.threads;
+    if ((size_t)threadCount > caseCount) threadCount = (int)caseCount;
+
+    //Deal runs out in run order, or longest predicted first to shorten the tail where only the longest runs are left.
+    //Longest first within blocks of the writer's reorder window, so no worker holds a run the writer can't take ahead
+    //of one it's waiting on
+    std::vector<int> order(caseCount);
+    for (size_t i = 0; i < caseCount; ++i) order[i] = firstRun + (int)i;
+    if (settings.longest_first) {
+        std::vector<double> duration(caseCount);
+        for (size_t i = 0; i < caseCount; ++i) duration[i] = predictDuration(generator.makeCase(order[i]));
+        std::stable_sort(order.begin(), order.end(), [&duration, firstRun](int lhs, int rhs) {
+            int lhs_block = (lhs - firstRun) / SolutionWriter::k_ReorderWindow;
+            int rhs_block = (rhs - firstRun) / SolutionWriter::k_ReorderWindow;
+            if (lhs_block != rhs_block) return lhs_block < rhs_block;
+            return duration[lhs - firstRun] > duration[rhs - firstRun];
+        });
+    }
+    Scheduler scheduler(threadCount);
+    scheduler.assign(order);
+
+    Topology topology;
+    WorkerContext context;
+    context.generator = &generator;
+    context.scheduler = &scheduler;
+    context.topology = &topology;
+    SolutionWriter writer(settings.fileprefix, firstRun, endRun, !settings.gates.empty());
+    writer.setCancelFlag(&abort);
+    context.writer = &writer;
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        active_writer = &writer;
+    }
+
+    //Copy the atmosphere onto every other NUMA node the workers will run on. Each copy is made by a thread pinned to
+    //that node, so its pages are allocated there
+    int nodeCount = settings.pin_threads ? std::min(topology.getNodeCount(), std::max(threadCount, 1)) : 1;
+    std::vector<std::unique_ptr<Earth>> replicas(nodeCount);
+    context.node_earth.assign(nodeCount, &earth);
+    std::vector<std::thread> replicators;
+    for (int node = 1; node < nodeCount; ++node) {
+        replicators.emplace_back([&, node]() {
+            Topology::pinThread(topology.getWorkerCore(node));
+            replicas[node].reset(new Earth(earth));
+        });
+    }
+    for (auto& thread : replicators) thread.join();
+    for (int node = 1; node < nodeCount; ++node) context.node_earth[node] = replicas[node].get();
+
+    writer.start();
+    auto start = std::chrono::steady_clock::now();
+    auto workerFunction = (settings.batch > 0) ? &Campaign::batchWorker : &Campaign::worker;
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threadCount; ++t) {
+        workers.emplace_back(workerFunction, this, t, std::ref(context));
+    }
+    if (threadCount > 0) (this->*workerFunction)(0, context);
+    for (auto& thread : workers) thread.join();
+    double makespan = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    writer.finish();
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        statistics = writer.getStatistics();
+        active_writer = nullptr;
+    }
+
+    if (!error && !cancelled) {
+        std::ofstream statisticsfile(settings.fileprefix + "statistics.csv");
+        statistics.write(statisticsfile);
+        std::ofstream blocksfile(settings.fileprefix + "statistics_blocks.csv");
+        StatisticsBlock::write(blocksfile, writer.getStatisticsBlocks());
+    }
+
+    if (vector_lane_steps > 0) {
+        std::cout << "Batch vector occupancy: " << 100.0 * active_lane_steps / vector_lane_steps << "%" << std::endl;
+    }
+    if (threadCount > 1) {
+        std::cout << "Load balance efficiency: " << 100.0 * scheduler.getEfficiency(makespan) << "% over " << threadCount
+                  << " threads (" << makespan << " secs, " << scheduler.getStealCount() << " runs stolen)" << std::endl;
+    }
+
+    if (error) std::rethrow_exception(error);
+}
+
+const Earth& Campaign::startWorker(int index, WorkerContext& context) {
+    if (!settings.pin_threads) return earth;
+    Topology::pinThread(context.topology->getWorkerCore(index));
+    int node = context.topology->getWorkerNode(index);
+    return (node < (int)context.node_earth.size()) ? *context.node_earth[node] : earth;
+}
+
+void Campaign::setError() {
+    std::lock_guard<std::mutex> lock(error_mutex);
+    if (!error) error = std::current_exception();
+    abort = true;
+}
+
+void Campaign::deliver(WorkerContext& context, SolutionRecord solution) {
+    solution.dT_error = settings.dT_error;
+    solution.dT_time_error = settings.dT_time_error;
+    if (result_callback) result_callback(solution);
+    context.writer->push(std::move(solution));
+}
+
+void Campaign::worker(int index, WorkerContext& context) {
+    auto start = std::chrono::steady_clock::now();
+    const Earth& workerEarth = startWorker(index, context);
+    int i;
+    while (!abort && context.scheduler->next(index, i)) {
+        try {
+            RunCase runCase = context.generator->makeCase(i);
+            std::unique_ptr<Projectile> projectile = makeProjectile(runCase);
+            Simulation sim(workerEarth, projectile.get(), settings.dT, settings.fulloutput, runCase.run_num, settings.fileprefix);
+            sim.setIntegrator(settings.integrator);
+            sim.setForces(settings.forces);
+            sim.setCancelFlag(&abort);
+            sim.setCoastAltitude(settings.coast_alt);
+            sim.setRunLimits(settings.limits);
+            sim.setFlatEarth(settings.flat_earth, runCase.parms.pos_LLA);
+            sim.setGates(settings.gates);
+            sim.run();
+            //A run stopped part way through has no result
+            if (abort) break;
+            SolutionRecord solution = sim.getSolution();
+            if (settings.richardson_order > 0) {
+                //Paired run at twice dT. Never has full output, which would overwrite the run's own
+                std::unique_ptr<Projectile> coarseProjectile = makeProjectile(runCase);
+                Simulation coarse(workerEarth, coarseProjectile.get(), 2 * settings.dT, false, runCase.run_num);
+                coarse.setIntegrator(settings.integrator);
+                coarse.setForces(settings.forces);
+                coarse.setCancelFlag(&abort);
+                coarse.setCoastAltitude(settings.coast_alt);
+                coarse.setRunLimits(settings.limits);
+                coarse.setFlatEarth(settings.flat_earth, runCase.parms.pos_LLA);
+                coarse.run();
+                if (abort) break;
+                Simulation::extrapolate(solution, coarse.getSolution(), settings.richardson_order);
+            }
+            deliver(context, solution);
+        }
+        catch (...) {
+            setError();
+        }
+    }
+    context.scheduler->setBusyTime(index, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+void Campaign::batchWorker(int index, WorkerContext& context) {
+    auto start = std::chrono::steady_clock::now();
+    const Earth& workerEarth = startWorker(index, context);
+    BatchSimulation batch(workerEarth, settings.dT, settings.limits);
+    try {
+        int i;
+        while ((batch.size() < settings.batch) && !abort && context.scheduler->next(index, i)) {
+            std::unique_ptr<Projectile> projectile = makeProjectile(context.generator->makeCase(i));
+            batch.addRun(projectile.get(), i);
+        }
+        //Finished lanes wait here until the writer takes their runs. The batch may hold the run the writer is waiting
+        //on, so it mustn't wait in push() while it still has runs to step
+        std::vector<int> parked;
+        bool running = true;
+        for (;;) {
+            int lane;
+            while (batch.popFinished(lane)) parked.push_back(lane);
+            if (abort || (!running && parked.empty())) break;
+            if (!running) {
+                //Nothing left to step, so the writer's waiting on other workers. Wait for it, as push() would
+                int first = batch.getRunNum(*std::min_element(parked.begin(), parked.end(), [&batch](int lhs, int rhs) {
+                    return batch.getRunNum(lhs) < batch.getRunNum(rhs);
+                }));
+                while (!abort && !context.writer->accepts(first)) std::this_thread::yield();
+            }
+            for (size_t p = 0; p < parked.size();) {
+                lane = parked[p];
+                if (!context.writer->accepts(batch.getRunNum(lane))) {
+                    ++p;
+                    continue;
+                }
+                deliver(context, batch.getSolution(lane));
+                parked.erase(parked.begin() + p);
+                if (!abort && context.scheduler->next(index, i)) {
+                    std::unique_ptr<Projectile> projectile = makeProjectile(context.generator->makeCase(i));
+                    batch.setRun(lane, projectile.get(), i);
+                }
+            }
+            running = batch.step();
+        }
+    }
+    catch (...) {
+        setError();
+    }
+    active_lane_steps += batch.getActiveLaneSteps();
+    vector_lane_steps += batch.getVectorLaneSteps();
+    context.scheduler->setBusyTime(index, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+} // namespace trajectorysim
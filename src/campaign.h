@@ -0,0 +1,198 @@
+#pragma once
+#include "Earth.h"
+#include "Projectile.h"
+#include "Scheduler.h"
+#include "Simulation.h"
+#include "SolutionWriter.h"
+#include "Topology.h"
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace trajectorysim {
+
+// Inputs for a single run. Also used to hold the standard deviation of each input when dispersing
+struct RunParms {
+    Earth::LatLonAlt pos_LLA;
+    Earth::Coords vel_ECEF;
+    double mass;
+    double length;
+    double diameter;
+    double impulse;
+    double Cd_subsonic;
+    double Cd_supersonic;
+    std::string shape;
+};
+
+// Dispersed inputs for a single run, ready to be simulated
+struct RunCase {
+    int run_num;
+    RunParms parms;
+    Earth::Coords impulse_dir;
+};
+
+// Selects which inputs are dispersed
+struct DispersionFlags {
+    bool pos;
+    bool vel;
+    bool mass;
+    bool length;
+    bool diameter;
+    bool impulse;
+    bool Cd_subsonic;
+    bool Cd_supersonic;
+};
+
+// Generates the dispersed inputs of a campaign's runs. Every input is drawn from its own counter-based stream keyed by
+// (seed, run number, input), so any run's case can be generated directly, in O(1), without generating the runs before it
+class CaseGenerator
+{
+public:
+    CaseGenerator(RunParms nominal, RunParms stdDeviation, DispersionFlags flags, uint64_t seed);
+
+    // Returns the dispersed inputs of run run_num
+    RunCase makeCase(int run_num) const;
+
+    // Returns the undispersed inputs, as run 0. The impulse direction is always random, so is run 0's
+    RunCase makeNominalCase() const;
+
+    uint64_t getSeed() const;
+
+private:
+    RunParms nominal;
+    RunParms stdDeviation;
+    DispersionFlags flags;
+    uint64_t seed;
+};
+
+struct CampaignSettings {
+    double dT;
+    bool fulloutput;
+    std::string fileprefix;
+    int threads;
+    // Runs per BatchSimulation on each worker. 0 simulates each run separately, using Simulation
+    int batch;
+    // Start the runs with the longest predicted duration first
+    bool longest_first;
+    // Pin each worker to a core, spreading workers over NUMA nodes, and give each node its own copy of the atmosphere
+    bool pin_threads;
+    IntegratorSettings integrator;
+    // Force models. Batches only use gravity and drag
+    ForceSettings forces;
+    // Error estimate of dT from TimestepCalibration, recorded with each run's solution. Negative if not calibrated
+    double dT_error;
+    double dT_time_error;
+    // If positive, each run is paired with a run at twice dT, and its impact Richardson extrapolated assuming
+    // convergence at this order. Unbatched only
+    int richardson_order;
+    // Altitude, in m, above which runs coast along their drag-free orbit. Negative never coasts. Unbatched only
+    double coast_alt;
+    // Start fixed-step runs in the plane tangent to the earth below their initial position. Unbatched only
+    FlatEarthSettings flat_earth;
+    // Batched runs ignore max_wall_time
+    RunLimits limits;
+    // Gates whose crossings are written to [prefix]gates.csv. Unbatched only
+    GateSettings gates;
+};
+
+// Runs a set of independent simulations (a Monte Carlo campaign) over a pool of worker threads
+class Campaign
+{
+public:
+    // earth is shared read-only by all workers, and must outlive the campaign. With settings.pin_threads, workers on
+    // other NUMA nodes use a copy of it made on their own node
+    // settings.threads sets the number of worker threads. 0 will use one thread per hardware core
+    // settings.batch is ignored if settings.fulloutput is set, as batches don't produce per-step output, or if
+    // settings.integrator is not the constant-acceleration update, the only one batches use, or settings.forces are not
+    // gravity and drag
+    Campaign(const Earth& earth, CampaignSettings settings);
+
+    // Simulates runs firstRun to endRun - 1, each worker generating its own cases and using its own Simulation and
+    // Projectile. As each run's case depends only on the seed and run number, a campaign can be split into run ranges,
+    // run by separate processes, and merged with CampaignMerge.
+    // Runs are handed out by a work-stealing Scheduler, and the load-balance efficiency it achieved is reported.
+    // Results are passed to a SolutionWriter as each run completes, which appends them to [prefix]solution.csv in
+    // run order, regardless of the order they complete in. Statistics of the impact points and times of the runs are
+    // written to [prefix]statistics.csv, reduced in a fixed order so they are bit-identical for any number of threads,
+    // along with the partial reductions needed to merge them, in [prefix]statistics_blocks.csv.
+    // Exceptions thrown by a run stop the campaign and are rethrown once all workers have finished
+    void run(const CaseGenerator& generator, int firstRun, int endRun);
+
+    // Returns true if shape is one that makeProjectile() can build
+    static bool isValidShape(const std::string& shape);
+
+    // Builds the projectile for a case, with the impulse applied to its initial velocity.
+    // Returns nullptr if the case's shape is not recognised
+    static std::unique_ptr<Projectile> makeProjectile(const RunCase& runCase);
+
+    // Returns a cheap estimate of a run's duration in simulated secs, used to order runs longest first
+    static double predictDuration(const RunCase& runCase);
+
+    // Returns the number of worker threads the campaign will use
+    int getThreadCount();
+
+    // Called from the worker threads with each run's results as soon as it completes, in completion order
+    typedef std::function<void(const SolutionRecord&)> ResultCallback;
+
+    // Sets the function called with each run's results. Must be set before run() is called
+    void setResultCallback(ResultCallback callback);
+
+    // Stops the campaign from any thread. Runs in progress stop at their next step and are discarded, no more runs are
+    // started, and run() returns once the workers have stopped. Also stops any later call to run()
+    void cancel();
+
+    // Returns true if cancel() has been called
+    bool isCancelled();
+
+    // Returns the statistics of the runs written so far, which are the runs from the start of the range up to the
+    // first run still in progress. Safe to call from any thread while run() is in progress
+    StatisticsNode getStatistics();
+
+private:
+    // State shared by the workers during a call to run()
+    struct WorkerContext {
+        const CaseGenerator* generator;
+        Scheduler* scheduler;
+        Topology* topology;
+        SolutionWriter* writer;
+        // Atmosphere model to use on each NUMA node
+        std::vector<const Earth*> node_earth;
+    };
+
+    // Pins worker index to its core if enabled, and returns the atmosphere model it should use
+    const Earth& startWorker(int index, WorkerContext& context);
+
+    // Worker loop. Takes runs from the scheduler as worker index until none remain, or until a run throws
+    void worker(int index, WorkerContext& context);
+
+    // Worker loop for batched campaigns. Propagates settings.batch runs together, retiring each run as soon as it
+    // finishes and refilling its lane with the next unclaimed run, so lanes stay busy until every run has started
+    void batchWorker(int index, WorkerContext& context);
+
+    // Records an exception thrown by a run, and stops the campaign
+    void setError();
+
+    // Passes a completed run's results to the result callback and the writer
+    void deliver(WorkerContext& context, SolutionRecord solution);
+
+    const Earth& earth;
+    CampaignSettings settings;
+    ResultCallback result_callback;
+    // Set to stop the workers, on an error or when cancelled
+    std::atomic<bool> abort;
+    std::atomic<bool> cancelled;
+    // Writer of the campaign in progress, if any, or the statistics of the last campaign
+    std::mutex writer_mutex;
+    SolutionWriter* active_writer;
+    StatisticsNode statistics;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    std::atomic<long long> active_lane_steps;
+    std::atomic<long long> vector_lane_steps;
+};
+} // namespace trajectorysim
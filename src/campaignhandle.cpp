@@ -0,0 +1,137 @@
+#include "stdafx.h"
+#include "CampaignHandle.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace trajectorysim {
+
+CampaignHandle::CampaignHandle(const Earth& earth, const CaseGenerator& generator, CampaignSettings settings, int firstRun, int endRun)
+    : generator(generator), campaign(earth, settings), completed(0), done(false)
+{
+    held = 0;
+    CampaignHandle::firstRun = firstRun;
+    CampaignHandle::endRun = endRun > firstRun ? endRun : firstRun;
+    finished.assign(CampaignHandle::endRun - firstRun, false);
+    campaign.setResultCallback([this](const SolutionRecord& solution) { onResult(solution); });
+    thread = std::thread(&CampaignHandle::runCampaign, this);
+}
+
+CampaignHandle::~CampaignHandle() {
+    if (!done) campaign.cancel();
+    join();
+}
+
+CampaignHandle::Result& CampaignHandle::getEntry(int run_num) {
+    //Promises are only created for runs that have completed or been asked for
+    auto entry = results.find(run_num);
+    if (entry == results.end()) {
+        entry = results.emplace(run_num, Result()).first;
+        entry->second.future = entry->second.promise.get_future().share();
+        entry->second.set = false;
+    }
+    return entry->second;
+}
+
+std::shared_future<SolutionRecord> CampaignHandle::getResult(int run_num) {
+    if ((run_num < firstRun) || (run_num >= endRun)) throw std::out_of_range("Run not in campaign");
+    std::lock_guard<std::mutex> lock(results_mutex);
+    auto entry = results.find(run_num);
+    if ((entry == results.end()) && finished[run_num - firstRun]) throw std::out_of_range("Run result no longer held");
+    if (isHeld(run_num)) --held;
+    Result& result = getEntry(run_num);
+    if (done && !result.set) {
+        //The campaign has already ended without this run
+        result.promise.set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+        result.set = true;
+    }
+    std::shared_future<SolutionRecord> future = result.future;
+    //Ready futures are handed out once, and hold their result themselves
+    if (result.set) results.erase(run_num);
+    return future;
+}
+
+int CampaignHandle::getCompletedCount() { return completed; }
+
+int CampaignHandle::getRunCount() { return endRun - firstRun; }
+
+double CampaignHandle::getProgress() {
+    int runCount = getRunCount();
+    return runCount > 0 ? (double)completed / runCount : 1.0;
+}
+
+StatisticsNode CampaignHandle::getStatistics() { return campaign.getStatistics(); }
+
+void CampaignHandle::cancel() { campaign.cancel(); }
+
+bool CampaignHandle::isDone() { return done; }
+
+void CampaignHandle::wait() {
+    join();
+    if (error) std::rethrow_exception(error);
+}
+
+void CampaignHandle::join() {
+    std::call_once(joined, [this]() { thread.join(); });
+}
+
+void CampaignHandle::onResult(const SolutionRecord& solution) {
+    {
+        std::lock_guard<std::mutex> lock(results_mutex);
+        finished[solution.run_num - firstRun] = true;
+        auto entry = results.find(solution.run_num);
+        if (entry != results.end()) {
+            //Already handed out, so the future now holds the result
+            entry->second.promise.set_value(solution);
+            results.erase(entry);
+        }
+        else {
+            Result& result = getEntry(solution.run_num);
+            result.promise.set_value(solution);
+            result.set = true;
+            unclaimed.push_back(solution.run_num);
+            ++held;
+            //Drop the oldest results still held, skipping runs asked for since
+            while (held > k_HeldResults) {
+                if (isHeld(unclaimed.front())) {
+                    results.erase(unclaimed.front());
+                    --held;
+                }
+                unclaimed.pop_front();
+            }
+            if (unclaimed.size() > 2 * (size_t)held + k_HeldResults) {
+                unclaimed.erase(std::remove_if(unclaimed.begin(), unclaimed.end(), [this](int run_num) {
+                    return !isHeld(run_num);
+                }), unclaimed.end());
+            }
+        }
+    }
+    ++completed;
+}
+
+bool CampaignHandle::isHeld(int run_num) {
+    auto entry = results.find(run_num);
+    return (entry != results.end()) && entry->second.set;
+}
+
+void CampaignHandle::runCampaign() {
+    try {
+        campaign.run(generator, firstRun, endRun);
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+
+    //Fail the futures handed out for runs that didn't complete. Only completed runs' results are left
+    std::lock_guard<std::mutex> lock(results_mutex);
+    for (auto entry = results.begin(); entry != results.end();) {
+        if (!entry->second.set) {
+            entry->second.promise.set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+            entry = results.erase(entry);
+        }
+        else {
+            ++entry;
+        }
+    }
+    done = true;
+}
+} // namespace trajectorysim
@@ -0,0 +1,100 @@
+#pragma once
+#include "Campaign.h"
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace trajectorysim {
+
+// Runs a campaign in the background, for programs embedding the simulator. Each run's results are available from a
+// future as soon as that run completes, while the campaign continues, and the campaign can be watched and cancelled
+// through the handle. Results are also written to the usual output files.
+// The handle only holds results until they're asked for, and then only the last k_HeldResults not yet asked for.
+class CampaignHandle
+{
+public:
+    // Number of completed runs' results held for callers that haven't asked for them yet
+    static const int k_HeldResults = 4096;
+
+    // Starts simulating runs firstRun to endRun - 1 on a background thread, and returns immediately.
+    // earth must outlive the handle
+    CampaignHandle(const Earth& earth, const CaseGenerator& generator, CampaignSettings settings, int firstRun, int endRun);
+
+    // Cancels the campaign if it is still running, and waits for it to stop
+    ~CampaignHandle();
+
+    // Returns a future for run run_num's results, which becomes ready once the run completes. If the campaign ends
+    // without completing the run, through cancellation or an error, the future holds a broken_promise future_error.
+    // Throws std::out_of_range if run_num is outside the campaign's range, or its result is no longer held: its future
+    // was handed out once ready, or the run completed more than k_HeldResults runs before it was asked for
+    std::shared_future<SolutionRecord> getResult(int run_num);
+
+    // Returns the number of runs completed so far, and the number of runs in the campaign
+    int getCompletedCount();
+    int getRunCount();
+
+    // Returns the fraction of runs completed, from 0 to 1
+    double getProgress();
+
+    // Returns the statistics of the runs written so far, in run order from the start of the range
+    StatisticsNode getStatistics();
+
+    // Asks the campaign to stop. Runs in progress stop at their next step. Returns without waiting for them
+    void cancel();
+
+    // Returns true once the campaign has finished or stopped
+    bool isDone();
+
+    // Waits for the campaign to finish or stop, rethrowing any exception that stopped it
+    void wait();
+
+private:
+    // A run's result, and whether it has been set
+    struct Result {
+        std::promise<SolutionRecord> promise;
+        std::shared_future<SolutionRecord> future;
+        bool set;
+    };
+
+    // Returns the result entry of run_num, creating it if needed. results_mutex must be held
+    Result& getEntry(int run_num);
+
+    // Called by the workers as each run completes
+    void onResult(const SolutionRecord& solution);
+
+    // Returns true if run_num's result is held, completed and not yet asked for. results_mutex must be held
+    bool isHeld(int run_num);
+
+    // Background thread. Runs the campaign, then fails the futures of runs it didn't complete
+    void runCampaign();
+
+    // Waits for the background thread to end. Safe to call from any number of threads
+    void join();
+
+    CaseGenerator generator;
+    Campaign campaign;
+    int firstRun;
+    int endRun;
+    std::mutex results_mutex;
+    // Runs asked for but not yet completed, and completed runs not yet asked for
+    std::map<int, Result> results;
+    // Completed runs in the order they completed, oldest first, to drop the oldest results not asked for beyond
+    // k_HeldResults. May still list runs since asked for, which are skipped, and compacted away once they outnumber
+    // the results held
+    std::deque<int> unclaimed;
+    // Number of completed runs' results held that haven't been asked for
+    int held;
+    // Whether each run, from firstRun, has completed. Completed runs missing from results are no longer held
+    std::vector<bool> finished;
+    std::atomic<int> completed;
+    std::atomic<bool> done;
+    std::exception_ptr error;
+    std::thread thread;
+    std::once_flag joined;
+};
+} // namespace trajectorysim
@@ -0,0 +1,74 @@
+#include "stdafx.h"
+#include "CampaignMerge.h"
+#include "Simulation.h"
+#include "Statistics.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+
+namespace trajectorysim {
+
+int CampaignMerge::merge(const std::vector<std::string>& shardPrefixes, const std::string& fileprefix) {
+    //Solution rows are copied as written, keyed by the run number in their first column
+    std::map<long long, std::string> rows;
+    //Each run has any number of gate rows, kept in the order written. Only merged if the shards recorded gates
+    std::multimap<long long, std::string> gate_rows;
+    bool gates = false;
+    std::vector<StatisticsBlock> blocks;
+    for (const std::string& shardPrefix : shardPrefixes) {
+        std::ifstream solutionfile(shardPrefix + "solution.csv");
+        if (!solutionfile.good()) throw 30;
+        std::string line;
+        std::getline(solutionfile, line);
+        while (std::getline(solutionfile, line)) {
+            if (line.empty()) continue;
+            long long run_num = std::atoll(line.c_str());
+            if (!rows.emplace(run_num, line).second) throw 31;
+        }
+
+        std::ifstream gatesfile(shardPrefix + "gates.csv");
+        if (gatesfile.good()) {
+            gates = true;
+            std::getline(gatesfile, line);
+            while (std::getline(gatesfile, line)) {
+                if (line.empty()) continue;
+                gate_rows.emplace(std::atoll(line.c_str()), line);
+            }
+        }
+
+        std::ifstream blocksfile(shardPrefix + "statistics_blocks.csv");
+        if (!blocksfile.good()) throw 30;
+        if (!StatisticsBlock::read(blocksfile, blocks)) throw 32;
+    }
+
+    std::ofstream solutionfile(fileprefix + "solution.csv");
+    Simulation::writeSolutionHeader(solutionfile);
+    for (const auto& row : rows) solutionfile << row.second << "\n";
+    if (gates) {
+        std::ofstream gatesfile(fileprefix + "gates.csv");
+        Simulation::writeGatesHeader(gatesfile);
+        for (const auto& row : gate_rows) gatesfile << row.second << "\n";
+    }
+
+    //Blocks are whole subtrees of the reduction tree, so adding them in run order reproduces the single-process result.
+    //Each shard's blocks tile its range, so in run order each block starts where the last ended, unless runs are missing
+    std::sort(blocks.begin(), blocks.end(), [](const StatisticsBlock& lhs, const StatisticsBlock& rhs) {
+        return lhs.start < rhs.start;
+    });
+    StatisticsTree tree;
+    int64_t end = blocks.empty() ? 0 : blocks.front().start;
+    for (const StatisticsBlock& block : blocks) {
+        if (block.start < end) throw 31;
+        if (block.start > end) throw 33;
+        tree.add(block.level, block.start, block.node);
+        end = block.start + ((int64_t)1 << block.level);
+    }
+    std::ofstream statisticsfile(fileprefix + "statistics.csv");
+    tree.finalize().write(statisticsfile);
+    std::ofstream blocksfile(fileprefix + "statistics_blocks.csv");
+    StatisticsBlock::write(blocksfile, blocks);
+
+    return (int)rows.size();
+}
+} // namespace trajectorysim
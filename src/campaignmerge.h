@@ -0,0 +1,20 @@
+#pragma once
+#include <string>
+#include <vector>
+
+namespace trajectorysim {
+
+// Combines the outputs of a campaign that was split into run ranges and run as separate processes, each with its own
+// file prefix. The merged output is identical to running the whole campaign in a single process.
+class CampaignMerge
+{
+public:
+    // Merges each shard's [shard prefix]solution.csv into [fileprefix]solution.csv in run order, and its
+    // [shard prefix]statistics_blocks.csv into [fileprefix]statistics.csv and [fileprefix]statistics_blocks.csv, so
+    // merged outputs can themselves be merged. Shards' [shard prefix]gates.csv, if recorded, are merged into
+    // [fileprefix]gates.csv. Returns the number of runs merged.
+    // Throws 30 if a shard's output is missing, 31 if shards hold the same run, 32 if a shard's statistics are unreadable,
+    // and 33 if the shards' run ranges leave a gap
+    static int merge(const std::vector<std::string>& shardPrefixes, const std::string& fileprefix);
+};
+} // namespace trajectorysim
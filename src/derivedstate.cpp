@@ -0,0 +1,31 @@
+#include "stdafx.h"
+#include "DerivedState.h"
+#include <cmath>
+
+namespace trajectorysim {
+
+DerivedState DerivedState::compute(const Earth& earth, const Earth::Coords& pos, const Earth::Coords& vel, double altitude) {
+    DerivedState state;
+    state.pos = pos;
+    state.vel = vel;
+    state.altitude = altitude;
+
+    state.radius = sqrt(pos.x * pos.x + pos.y * pos.y + pos.z * pos.z);
+    double inv_radius = 1 / state.radius;
+    state.radial = Earth::Coords{ pos.x * inv_radius, pos.y * inv_radius, pos.z * inv_radius };
+
+    double speed2 = vel.x * vel.x + vel.y * vel.y + vel.z * vel.z;
+    state.speed = sqrt(speed2);
+    double inv_speed = state.speed > 0 ? 1 / state.speed : 0;
+    state.heading = Earth::Coords{ vel.x * inv_speed, vel.y * inv_speed, vel.z * inv_speed };
+
+    state.air = earth.setProperties(altitude);
+    state.mach = state.speed / state.air.speed_of_sound;
+    state.dynamic_pressure = state.air.density * speed2 / 2;
+    return state;
+}
+
+bool DerivedState::isSubsonic() const {
+    return air.speed_of_sound > speed;
+}
+} // namespace trajectorysim
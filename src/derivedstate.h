@@ -0,0 +1,29 @@
+#pragma once
+#include "Earth.h"
+
+namespace trajectorysim {
+
+// Quantities derived from a projectile's position and velocity, computed once for each evaluation of its acceleration,
+// and read by every force model, so none of them is recomputed
+struct DerivedState {
+    Earth::Coords pos;
+    Earth::Coords vel;
+    double altitude;
+    // Distance from the centre of the earth, and the unit vector away from it
+    double radius;
+    Earth::Coords radial;
+    // Speed, and the unit vector along the velocity. Zero if at rest
+    double speed;
+    Earth::Coords heading;
+    Earth::Properties air;
+    double mach;
+    // 1/2 rho v^2, in Pa
+    double dynamic_pressure;
+
+    // altitude is that of pos, which projectiles already hold
+    static DerivedState compute(const Earth& earth, const Earth::Coords& pos, const Earth::Coords& vel, double altitude);
+
+    // Returns true if below the speed of sound, which selects the drag coefficient
+    bool isSubsonic() const;
+};
+} // namespace trajectorysim
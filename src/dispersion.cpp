@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "Dispersion.h"
+#include <cmath>
 
 namespace trajectorysim {
 
@@ -9,11 +10,9 @@ Dispersion::Dispersion()
 
 const double Dispersion::k_PI = 3.14159265359;
 
-Earth::Coords Dispersion::Random3DUnitVector(std::mt19937 &rng) {
-    std::uniform_real_distribution<double> distr(0, 1);
-
-    double theta = 2 * k_PI * distr(rng);
-    double phi = acos(2 * distr(rng) - 1);
+Earth::Coords Dispersion::Random3DUnitVector(RandomStream &rng) {
+    double theta = 2 * k_PI * rng.uniform();
+    double phi = acos(2 * rng.uniform() - 1);
 
     Earth::Coords UnitVector{
         sin(theta)*cos(phi),
@@ -23,54 +22,41 @@ Earth::Coords Dispersion::Random3DUnitVector(std::mt19937 &rng) {
     return UnitVector;
 }
 
-Earth::Coords Dispersion::Disperse3DVector(std::mt19937 &rng, Earth::Coords mean, Earth::Coords stdDeviation) {
+Earth::Coords Dispersion::Disperse3DVector(RandomStream &rng, Earth::Coords mean, Earth::Coords stdDeviation) {
     //Generate normal distribution for 3d coords
     Earth::Coords output;
+    double normal_x = rng.normal();
     if (stdDeviation.x <= 0) output.x = mean.x;
-    else {
-        std::normal_distribution<double> distr(mean.x, stdDeviation.x);
-        output.x = distr(rng);
-    }
+    else output.x = mean.x + stdDeviation.x * normal_x;
+    double normal_y = rng.normal();
     if (stdDeviation.y <= 0) output.y = mean.y;
-    else {
-        std::normal_distribution<double> distr(mean.y, stdDeviation.y);
-        output.y = distr(rng);
-    }
+    else output.y = mean.y + stdDeviation.y * normal_y;
+    double normal_z = rng.normal();
     if (stdDeviation.z <= 0) output.z = mean.z;
-    else {
-        std::normal_distribution<double> distr(mean.z, stdDeviation.z);
-        output.z = distr(rng);
-    }
+    else output.z = mean.z + stdDeviation.z * normal_z;
     return output;
 }
 
-Earth::LatLonAlt Dispersion::Disperse3DVector(std::mt19937 &rng, Earth::LatLonAlt mean, Earth::LatLonAlt stdDeviation) {
+Earth::LatLonAlt Dispersion::Disperse3DVector(RandomStream &rng, Earth::LatLonAlt mean, Earth::LatLonAlt stdDeviation) {
     //Generate normal distribution for 3d coords
     Earth::LatLonAlt output;
+    double normal_lat = rng.normal();
     if (stdDeviation.lat <= 0) output.lat = mean.lat;
-    else {
-        std::normal_distribution<double> distr(mean.lat, stdDeviation.lat);
-        output.lat = distr(rng);
-    }
+    else output.lat = mean.lat + stdDeviation.lat * normal_lat;
+    double normal_lon = rng.normal();
     if (stdDeviation.lon <= 0) output.lon = mean.lon;
-    else {
-        std::normal_distribution<double> distr(mean.lon, stdDeviation.lon);
-        output.lon = distr(rng);
-    }
+    else output.lon = mean.lon + stdDeviation.lon * normal_lon;
+    double normal_alt = rng.normal();
     if (stdDeviation.alt <= 0) output.alt = mean.alt;
-    else {
-        std::normal_distribution<double> distr(mean.alt, stdDeviation.alt);
-        output.alt = distr(rng);
-    }
+    else output.alt = mean.alt + stdDeviation.alt * normal_alt;
     return output;
 }
 
-double Dispersion::DisperseInput(std::mt19937 &rng, double mean, double stdDeviation, bool allowNegative) {
+double Dispersion::DisperseInput(RandomStream &rng, double mean, double stdDeviation, bool allowNegative) {
     //Generate normal distribution
     double output;
     if (stdDeviation <= 0) return mean;
-    std::normal_distribution<double> distr(mean, stdDeviation);
-    output = distr(rng);
+    output = mean + stdDeviation * rng.normal();
     if (!allowNegative && (output < 0)) output = 1e-9; //return a very small number
     return output;
 }
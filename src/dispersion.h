@@ -1,6 +1,7 @@
 #pragma once
 #include "Earth.h"
-#include <random>
+#include "RandomStream.h"
+#include <cstdint>
 
 namespace trajectorysim {
 //Provides methods for dispersion of inputs
@@ -10,18 +11,33 @@ public:
     Dispersion();
     static const double k_PI;
 
+    // Identifies the random stream each input draws from, as the parameter id of a RandomStream.
+    // Each input has its own stream, so dispersing one input never changes the values drawn for another
+    enum Parameter : uint32_t {
+        k_Position = 1,
+        k_Velocity,
+        k_Mass,
+        k_Length,
+        k_Diameter,
+        k_Impulse,
+        k_ImpulseDirection,
+        k_CdSubsonic,
+        k_CdSupersonic
+    };
+
     // Returns a random 3D unit vector. Random distribution is designed to be uniformly
     // distributed around the surface of a sphere, and avoids uneven distribution around poles
-    static Earth::Coords Random3DUnitVector(std::mt19937 &rng);
+    static Earth::Coords Random3DUnitVector(RandomStream &rng);
 
     // Returns a set of 3D coordinates, where each coordinate is normally distributed around the
     // corresponding input coordinate's mean and standard deviation
     // Separate methods are provided for output of Earth::Coords and Earth::LatLonAlt struts
-    static Earth::Coords Disperse3DVector(std::mt19937 &rng, Earth::Coords mean, Earth::Coords stdDeviation);
-    static Earth::LatLonAlt Disperse3DVector(std::mt19937 &rng, Earth::LatLonAlt mean, Earth::LatLonAlt stdDeviation);
+    // Three normals are always drawn, so each coordinate uses the same draw whether or not the others are dispersed
+    static Earth::Coords Disperse3DVector(RandomStream &rng, Earth::Coords mean, Earth::Coords stdDeviation);
+    static Earth::LatLonAlt Disperse3DVector(RandomStream &rng, Earth::LatLonAlt mean, Earth::LatLonAlt stdDeviation);
 
     // Returns a double normally distributed around the provided mean and standard deviation.
     // Setting allowNegative to false will set negative numbers to 1e-9 before returning.
-    static double DisperseInput(std::mt19937 &rng, double mean, double stdDeviation, bool allowNegative = true);
+    static double DisperseInput(RandomStream &rng, double mean, double stdDeviation, bool allowNegative = true);
 };
 } // namespace trajectorysim
\ No newline at end of file
@@ -1,57 +1,20 @@
 #include "stdafx.h"
 #include "Earth.h"
+#include "DerivedState.h"
+#include "Geodetic.h"
 #include <cmath>
-#include <fstream>
-#include <iostream>
-#include <string>
-#include <vector>
 
 namespace trajectorysim {
 
-static double LinearInterpolation(double x, double x1, double x2, double y1, double y2) {
-    return y1 + (y2 - y1) * (x - x1) / (x2 - x1);
-}
-
 Earth::Earth()
 {
-    atmo_properties = getAtmoTable();
+    atmosphere = AtmosphereTable::load("atmosphere.csv");
 }
 
 //From WGS84
 const double Earth::a = 6378137.0; //m
 const double Earth::f = 1.0 / 298.257223563;
-
-std::vector<std::vector<double>> Earth::getAtmoTable() {
-    std::ifstream filestream;
-    std::string output;
-    std::vector<std::vector<double>> atmo_properties;
-
-    filestream.open("atmosphere.csv");
-
-    if (!filestream) {
-        throw 10; //Will be caught in main()
-    }
-
-    std::getline(filestream, output);
-    std::getline(filestream, output);
-
-    int line = 0;
-    int col = 0;
-    while (std::getline(filestream, output)) {
-        std::vector<double> vecLine;
-        while (output.length() > 0) {
-            int index = output.find(",");
-            std::string valueStr = output.substr(0, index);
-            output = output.substr(index + 1, output.length() - index);
-            vecLine.push_back(std::stod(valueStr));
-            if (index == -1) {
-                break;
-            }
-        }
-        atmo_properties.push_back(vecLine);
-    }
-    return atmo_properties;
-}
+const double Earth::grav_const = -9.80665; // m/s^2, at the surface
 
 Earth::Coords Earth::LatLonAltToECEF(LatLonAlt pos_LLA) {
     const double k_PI = 3.14159265359;
@@ -70,95 +33,88 @@ Earth::Coords Earth::LatLonAltToECEF(LatLonAlt pos_LLA) {
     return posECEF;
 }
 
-double Earth::ECEFToAlt(Coords Pos_ECEF) {
-    //LatLonAlt Pos_LLA;
-    double altitude;
-
-    double s = sqrt(pow(Pos_ECEF.x, 2) + pow(Pos_ECEF.y, 2));
-    double e = sqrt(1 - pow((1 - f), 2));
-
-    //Pos_LLA.lon = atan(Pos_ECEF.y / Pos_ECEF.x);
-
-    double reduced_lat = atan(Pos_ECEF.z / ((1 - f)*s));
-    double geo_lat = atan((Pos_ECEF.z + ((pow(e, 2)*(1 - f)) / (1 - pow(e, 2)))*a*pow(sin(reduced_lat), 3)) / (s - pow(e, 2)*a*pow(cos(reduced_lat), 3)));
-    double prev_geo_lat;
-    int count = 0;
+//Solves Vermeille's closed form for a position. Returns k, the ratio of its distance from the ellipsoid's evolute to
+//that of the point below it on the ellipsoid, and sets D, its distance from the polar axis scaled to the evolute
+static double solveGeodetic(const Earth::Coords& pos, double& D) {
+    const double e2 = Earth::f * (2 - Earth::f);
+    const double e4 = e2 * e2;
+
+    double w2 = pos.x * pos.x + pos.y * pos.y;
+    double p = w2 / (Earth::a * Earth::a);
+    double q = (1 - e2) / (Earth::a * Earth::a) * pos.z * pos.z;
+    double r = (p + q - e4) / 6;
+    double s = e4 * p * q / (4 * r * r * r);
+    double t = cbrt(1 + s + sqrt(s * (2 + s)));
+    double u = r * (1 + t + 1 / t);
+    double v = sqrt(u * u + e4 * q);
+    double w = e2 * (u + v - q) / (2 * v);
+    double k = sqrt(u + v + w * w) - w;
+    D = k * sqrt(w2) / (k + e2);
+    return k;
+}
 
-    do {
-        if (count > 50) {
-            throw 20;
-        }
-        prev_geo_lat = geo_lat;
-        reduced_lat = atan(((1 - f)*sin(geo_lat)) / (cos(geo_lat)));
-        geo_lat = atan((Pos_ECEF.z + ((pow(e, 2)*(1 - f)) / (1 - pow(e, 2)))*a*pow(sin(reduced_lat), 3)) / (s - pow(e, 2)*a*pow(cos(reduced_lat), 3)));
-    } while (abs(geo_lat - prev_geo_lat) > 10.0);
+double Earth::ECEFToAlt(Coords Pos_ECEF) {
+    double D;
+    double k = solveGeodetic(Pos_ECEF, D);
+    return (k + f * (2 - f) - 1) / k * sqrt(D * D + Pos_ECEF.z * Pos_ECEF.z);
+}
 
-    //Pos_LLA.lat = atan(tan(geoLat) / pow((1 - f), 2));
+Earth::LatLonAlt Earth::ECEFToLLA(Coords Pos_ECEF) {
+    const double k_PI = 3.14159265359;
+    double D;
+    double k = solveGeodetic(Pos_ECEF, D);
+    double dz = sqrt(D * D + Pos_ECEF.z * Pos_ECEF.z);
+    return LatLonAlt{
+        2 * atan2(Pos_ECEF.z, D + dz) * 180.0 / k_PI,
+        atan2(Pos_ECEF.y, Pos_ECEF.x) * 180.0 / k_PI,
+        (k + f * (2 - f) - 1) / k * dz
+    };
+}
 
-    double N = a / sqrt(1 - pow(e, 2)*pow(sin(geo_lat), 2));
-    altitude = s * cos(geo_lat) + (Pos_ECEF.z + pow(e, 2)*N*sin(geo_lat))*sin(geo_lat) - N;
+void Earth::ECEFToLLA(const double* x, const double* y, const double* z, double* lat, double* lon, double* alt, size_t count) {
+    using namespace simd;
+    const double k_PI = 3.14159265359;
+    const Vec degrees = set1(180.0 / k_PI);
+    size_t i = 0;
+    for (; i + k_Width <= count; i += k_Width) {
+        Vec v_lat, v_lon, v_alt;
+        geodeticLLA(load(x + i), load(y + i), load(z + i), v_lat, v_lon, v_alt);
+        store(lat + i, v_lat * degrees);
+        store(lon + i, v_lon * degrees);
+        store(alt + i, v_alt);
+    }
+    for (; i < count; ++i) {
+        LatLonAlt pos_LLA = ECEFToLLA(Coords{ x[i], y[i], z[i] });
+        lat[i] = pos_LLA.lat;
+        lon[i] = pos_LLA.lon;
+        alt[i] = pos_LLA.alt;
+    }
+}
 
-    return altitude;
+double Earth::getGravity(double altitude) {
+    double ratio = a / (a + altitude);
+    return grav_const * ratio * ratio;
 }
 
 Earth::Coords Earth::Gravity_Accel(Earth::Coords pos_ECEF)
 {
-    const double grav_const = -9.80665; // m/s^2
-	double altitude = ECEFToAlt(pos_ECEF);
-	double grav_current = grav_const * pow((a / (a + altitude)), 2);
-    Earth::Coords a_gravity;
-    double alpha, beta, gamma;
-    double abs_pos;
-
-    abs_pos = sqrt(pow(pos_ECEF.x, 2) + pow(pos_ECEF.y, 2) + pow(pos_ECEF.z, 2));
-    alpha = acos(pos_ECEF.x / abs_pos);
-    beta = acos(pos_ECEF.y / abs_pos);
-    gamma = acos(pos_ECEF.z / abs_pos);
-
-    a_gravity.x = cos(alpha) * grav_current;
-    a_gravity.y = cos(beta) * grav_current;
-    a_gravity.z = cos(gamma) * grav_current;
-
-    return a_gravity;
+    double grav_current = getGravity(ECEFToAlt(pos_ECEF));
+    double abs_pos = sqrt(pos_ECEF.x * pos_ECEF.x + pos_ECEF.y * pos_ECEF.y + pos_ECEF.z * pos_ECEF.z);
+    double scale = grav_current / abs_pos;
+    return Coords{ pos_ECEF.x * scale, pos_ECEF.y * scale, pos_ECEF.z * scale };
 }
 
-double Earth::GetReynoldsNumber(double velocity, double charLength) {
+Earth::Coords Earth::Gravity_Accel(const DerivedState& state)
+{
+    double grav_current = getGravity(state.altitude);
+    return Coords{ state.radial.x * grav_current, state.radial.y * grav_current, state.radial.z * grav_current };
+}
+
+double Earth::GetReynoldsNumber(double velocity, double charLength) const {
     return velocity * charLength / (current_properties.dyn_viscosity / current_properties.density);
 }
 
-Earth::Properties Earth::setProperties(double altitude) {
-    //Find and interpolate from atmo table
-    int upperindex, lowerindex;
-    for (upperindex = 0; upperindex < atmo_properties.size(); ++upperindex) {
-        if (atmo_properties[upperindex][0] > altitude) break;
-    }
-    if (upperindex == atmo_properties.size()) {
-        //Higher than table. Return highest value
-        upperindex = atmo_properties.size() - 1;
-        lowerindex = upperindex;
-    }
-    else if (upperindex == 0) {
-        //Low altitude. Just use lowest table entry
-        upperindex = 0;
-        lowerindex = 0;
-    }
-    else lowerindex = upperindex - 1;
-    if (upperindex == lowerindex) {
-        //Don't bother interpolating
-        return Properties{
-            atmo_properties[upperindex][1],
-            atmo_properties[upperindex][2],
-            atmo_properties[upperindex][3],
-            atmo_properties[upperindex][4],
-            atmo_properties[upperindex][5]
-        };
-    }
-    return Properties{
-        LinearInterpolation(altitude, atmo_properties[lowerindex][0], atmo_properties[upperindex][0], atmo_properties[lowerindex][1], atmo_properties[upperindex][1]),
-        LinearInterpolation(altitude, atmo_properties[lowerindex][0], atmo_properties[upperindex][0], atmo_properties[lowerindex][2], atmo_properties[upperindex][2]),
-        LinearInterpolation(altitude, atmo_properties[lowerindex][0], atmo_properties[upperindex][0], atmo_properties[lowerindex][3], atmo_properties[upperindex][3]),
-        LinearInterpolation(altitude, atmo_properties[lowerindex][0], atmo_properties[upperindex][0], atmo_properties[lowerindex][4], atmo_properties[upperindex][4]),
-        LinearInterpolation(altitude, atmo_properties[lowerindex][0], atmo_properties[upperindex][0], atmo_properties[lowerindex][5], atmo_properties[upperindex][5])
-    };
+Earth::Properties Earth::setProperties(double altitude) const {
+    return atmosphere.lookup(altitude);
 }
 } // namespace trajectorysim
\ No newline at end of file
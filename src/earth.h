@@ -1,8 +1,11 @@
 #pragma once
-#include <vector>
+#include "Atmosphere.h"
+#include <cstddef>
 
 namespace trajectorysim {
 
+struct DerivedState;
+
 class Earth
 {
 public:
@@ -18,18 +21,14 @@ public:
         double alt;
     };
 
-    struct Properties {
-        double temp;
-        double press;
-        double density;
-        double speed_of_sound;
-        double dyn_viscosity;
-    };
+    typedef AtmosphereProperties Properties;
 
     static const double a;
     static const double f;
+    static const double grav_const;
 
-    std::vector<std::vector<double>> atmo_properties;
+    // The process's shared model of atmosphere.csv, copied so each Earth's table is in memory local to it
+    AtmosphereTable atmosphere;
     Properties current_properties;
 
     Earth();
@@ -37,21 +36,31 @@ public:
     // Outputs LatLonAlt coords to ECEF coords using WGS85
     static Coords LatLonAltToECEF(LatLonAlt pos_LLA);
 
-    // Outputs altitude at current ECEF coords, using WGS85
+    // Outputs altitude at current ECEF coords, using WGS85. Closed form, as in Geodetic.h, so exact and without
+    // iteration, for positions more than 1000 km from the centre of the earth
     static double ECEFToAlt(Coords Pos_ECEF);
 
+    // Outputs LatLonAlt coords at current ECEF coords, as ECEFToAlt
+    static LatLonAlt ECEFToLLA(Coords Pos_ECEF);
+
+    // Converts count ECEF positions, held as separate x, y and z arrays, to lat, lon and alt arrays, as ECEFToLLA,
+    // converting simd::k_Width positions at a time
+    static void ECEFToLLA(const double* x, const double* y, const double* z, double* lat, double* lon, double* alt, size_t count);
+
     // Provides acceleration of gravity in ECEF frame for given position
     static Earth::Coords Gravity_Accel(Coords Pos_ECEF);
 
+    // As above, for a state whose altitude and direction from the centre of the earth are already known
+    static Earth::Coords Gravity_Accel(const DerivedState& state);
+
+    // Returns the acceleration of gravity at altitude, negative as it's towards the centre of the earth
+    static double getGravity(double altitude);
+
     // Returns reynolds number for a given velocity. Must update aero
     // properties using setProperties() before running
-    double GetReynoldsNumber(double velocity, double charLength);
-
-    // Updates current aero properties from atmo_properties, based on current altitude
-    Properties setProperties(double altitude);
+    double GetReynoldsNumber(double velocity, double charLength) const;
 
-private:
-    // Pulls data from atmosphere.csv into atmo_properties
-    std::vector<std::vector<double>> getAtmoTable();
+    // Returns the aero properties at altitude, interpolated from the atmosphere table
+    Properties setProperties(double altitude) const;
 };
 } // namespace trajectorysim
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+#include "Earth.h"
+#include "Integrators.h"
+#include <algorithm>
+#include <cmath>
+
+namespace trajectorysim {
+
+// Finds a root of f in [a, b], given fa = f(a) and fb = f(b) of opposite signs, using Brent's method: inverse quadratic
+// interpolation or secant steps where they converge, falling back to bisection where they don't, so convergence is
+// guaranteed and usually superlinear. Returns once the root is bracketed to within tol
+template <typename Function>
+double findRoot(Function& f, double a, double b, double fa, double fb, double tol) {
+    if (fa == 0) return a;
+    if (fb == 0) return b;
+    double c = a, fc = fa;
+    double d = b - a, e = d;
+    for (int iteration = 0; iteration < 100; ++iteration) {
+        if (((fb > 0) && (fc > 0)) || ((fb < 0) && (fc < 0))) {
+            //Keep the root between b and c
+            c = a;
+            fc = fa;
+            d = e = b - a;
+        }
+        if (std::abs(fc) < std::abs(fb)) {
+            a = b; b = c; c = a;
+            fa = fb; fb = fc; fc = fa;
+        }
+        double tol1 = 2 * 2.2e-16 * std::abs(b) + 0.5 * tol;
+        double m = 0.5 * (c - b);
+        if ((std::abs(m) <= tol1) || (fb == 0)) return b;
+
+        if ((std::abs(e) >= tol1) && (std::abs(fa) > std::abs(fb))) {
+            //Interpolate: secant if only two distinct points, inverse quadratic otherwise
+            double p, q, r;
+            double s = fb / fa;
+            if (a == c) {
+                p = 2 * m * s;
+                q = 1 - s;
+            }
+            else {
+                q = fa / fc;
+                r = fb / fc;
+                p = s * (2 * m * q * (q - r) - (b - a) * (r - 1));
+                q = (q - 1) * (r - 1) * (s - 1);
+            }
+            if (p > 0) q = -q;
+            else p = -p;
+            if ((2 * p < std::min(3 * m * q - std::abs(tol1 * q), std::abs(e * q)))) {
+                e = d;
+                d = p / q;
+            }
+            else {
+                d = m;
+                e = m;
+            }
+        }
+        else {
+            d = m;
+            e = m;
+        }
+        a = b;
+        fa = fb;
+        b += (std::abs(d) > tol1) ? d : (m > 0 ? tol1 : -tol1);
+        fb = f(b);
+    }
+    return b;
+}
+
+// Locates where value(t) crosses zero between begin and end secs, given begin_value above zero and end_value on or
+// below it, returning end otherwise. Returns the time on or just past the crossing, so value there is on or below zero
+template <typename Function>
+double locateCrossing(Function& value, double begin, double end, double begin_value, double end_value) {
+    //To within a microsecond, a few mm at entry speeds
+    const double tol = 1e-6;
+    if ((begin_value <= 0) || (end_value > 0)) return end;
+    double t = findRoot(value, begin, end, begin_value, end_value, tol);
+    while ((t < end) && (value(t) > 0)) t = std::min(t + tol, end);
+    return t;
+}
+
+// Locates where the altitude along path crosses level, between begin and end secs, as locateCrossing()
+template <typename Path>
+double locateAltitude(const Path& path, double begin, double end, double begin_alt, double end_alt, double level) {
+    auto altitude = [&path, level](double t) { return Earth::ECEFToAlt(path.at(t).pos) - level; };
+    return locateCrossing(altitude, begin, end, begin_alt - level, end_alt - level);
+}
+
+// Locates the ground impact within a step of h secs that started above ground and ended on or below it, by finding
+// where the altitude along path, the step's dense output, crosses zero. Returns the time into the step, on or just
+// past the crossing, so the run is still seen to have ended
+template <typename Path>
+double locateImpact(const Path& path, double h, double start_alt, double end_alt) {
+    return locateAltitude(path, 0.0, h, start_alt, end_alt, 0.0);
+}
+} // namespace trajectorysim
@@ -0,0 +1,59 @@
+#include "stdafx.h"
+#include "Forces.h"
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+namespace trajectorysim {
+
+//The sets of models that can be selected. Each is its own fused kernel. Names list models in the order of k_ModelOrder
+static const ForceSettings k_ForceSets[] = {
+    { "gravity,drag", &DefaultForces::accel },
+    { "gravity", &ForcePipeline<GravityForce>::accel },
+    { "gravity,drag,j2", &ForcePipeline<GravityForce, DragForce, J2Force>::accel },
+    { "gravity,j2", &ForcePipeline<GravityForce, J2Force>::accel }
+};
+
+static const char* k_ModelOrder[] = { "gravity", "drag", "j2" };
+
+ForceSettings ForceSettings::defaults() {
+    return k_ForceSets[0];
+}
+
+bool ForceSettings::parse(const std::string& names, ForceSettings& forces) {
+    //Put the names in model order, so sets match however they were listed
+    std::vector<int> models;
+    std::istringstream stream(names);
+    std::string model;
+    while (std::getline(stream, model, ',')) {
+        const char** found = std::find(std::begin(k_ModelOrder), std::end(k_ModelOrder), model);
+        if (found == std::end(k_ModelOrder)) return false;
+        models.push_back((int)(found - std::begin(k_ModelOrder)));
+    }
+    std::sort(models.begin(), models.end());
+    std::ostringstream canonical;
+    for (size_t i = 0; i < models.size(); ++i) {
+        if ((i > 0) && (models[i] == models[i - 1])) return false;
+        canonical << (i > 0 ? "," : "") << k_ModelOrder[models[i]];
+    }
+    for (const ForceSettings& set : k_ForceSets) {
+        if (canonical.str() == set.name) {
+            forces = set;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string ForceSettings::getNames() {
+    std::ostringstream names;
+    for (const ForceSettings& set : k_ForceSets) {
+        names << (&set == k_ForceSets ? "" : ", ") << set.name;
+    }
+    return names.str();
+}
+
+bool ForceSettings::isDefault() const {
+    return kernel == k_ForceSets[0].kernel;
+}
+} // namespace trajectorysim
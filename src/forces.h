@@ -0,0 +1,84 @@
+#pragma once
+#include "DerivedState.h"
+#include "Earth.h"
+#include "Projectile.h"
+#include <string>
+
+namespace trajectorysim {
+
+// Force models. Each is a policy type whose static accel() returns its acceleration on projectile in state, in ECEF
+
+// The model's gravity, towards the centre of the earth, falling off with altitude
+struct GravityForce {
+    static Earth::Coords accel(const DerivedState& state, Projectile&) {
+        return Earth::Gravity_Accel(state);
+    }
+};
+
+// Aerodynamic drag, opposing the velocity
+struct DragForce {
+    static Earth::Coords accel(const DerivedState& state, Projectile& projectile) {
+        return projectile.GetDragAccel(state);
+    }
+};
+
+// The perturbation of gravity by the earth's oblateness, its J2 zonal harmonic. Adds to GravityForce, which only
+// falls off with altitude
+struct J2Force {
+    static Earth::Coords accel(const DerivedState& state, Projectile&) {
+        const double k_J2 = 1.08262668e-3;
+        const double k_Mu = 3.986004418e14; // m^3/s^2
+        double r2 = state.radius * state.radius;
+        double scale = -1.5 * k_J2 * k_Mu * Earth::a * Earth::a / (r2 * r2 * state.radius);
+        double z2 = 5 * state.pos.z * state.pos.z / r2;
+        return Earth::Coords{
+            scale * state.pos.x * (1 - z2),
+            scale * state.pos.y * (1 - z2),
+            scale * state.pos.z * (3 - z2)
+        };
+    }
+};
+
+// Sums the accelerations of Forces. As each model's accel() is inline, the compiler fuses the set into one kernel,
+// with nothing evaluated or branched on for models left out
+template <typename... Forces>
+struct ForcePipeline {
+    static Earth::Coords accel(const DerivedState& state, Projectile& projectile) {
+        Earth::Coords total{ 0, 0, 0 };
+        //Expands to one addition per model, in order
+        int expand[] = { 0, (add(total, Forces::accel(state, projectile)), 0)... };
+        (void)expand;
+        return total;
+    }
+
+private:
+    static void add(Earth::Coords& total, const Earth::Coords& accel) {
+        total.x += accel.x;
+        total.y += accel.y;
+        total.z += accel.z;
+    }
+};
+
+// Gravity and drag, the models batches and flat earth runs are limited to
+typedef ForcePipeline<GravityForce, DragForce> DefaultForces;
+
+// A set of force models selected at run time, from the ForcePipelines instantiated in Forces.cpp
+struct ForceSettings {
+    typedef Earth::Coords (*Kernel)(const DerivedState& state, Projectile& projectile);
+
+    // Names of the models, comma separated, as given to --forces
+    const char* name;
+    Kernel kernel;
+
+    // Returns DefaultForces
+    static ForceSettings defaults();
+
+    // Finds the set of models named in names, comma separated in any order. Returns false if not one of those instantiated
+    static bool parse(const std::string& names, ForceSettings& forces);
+
+    // Returns the names of the sets instantiated, for help text
+    static std::string getNames();
+
+    bool isDefault() const;
+};
+} // namespace trajectorysim
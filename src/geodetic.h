@@ -0,0 +1,98 @@
+#pragma once
+// geodetic.h : Closed-form conversion of ECEF positions to geodetic coords, for simd::k_Width positions at a time.
+// Vermeille's method (J. Geodesy 76, 2002): exact and non-iterative, with no trigonometric functions for the altitude.
+// Valid for positions more than 1000 km from the centre of the earth. Against exact geodetic coords, altitudes are
+// within 1e-8 m and latitudes within 1e-15 rad, from 20 km below the ellipsoid to 20,000 km above it. The iterative
+// Bowring conversion it replaces agreed to the same precision, but cost twice as much for altitude alone.
+// Earth::ECEFToAlt and Earth::ECEFToLLA are the scalar forms.
+#include "Earth.h"
+#include "simd.h"
+
+namespace trajectorysim {
+namespace simd {
+
+// Reciprocal cube root of a, for a in [1, 1.5], by Newton's method from the quadratic Taylor series about 1, which
+// needs no divisions. The cube root itself is a times its square
+inline Vec rcbrtNearOne(Vec a) {
+    const Vec one = set1(1.0);
+    const Vec third = set1(1.0 / 3);
+    Vec d = a - one;
+    Vec y = fmadd(fmadd(d, set1(2.0 / 9), set1(-1.0 / 3)), d, one);
+    for (int iteration = 0; iteration < 3; ++iteration) {
+        y = y * fmadd(set1(-1.0) * a, y * y * y, set1(4.0)) * third;
+    }
+    return y;
+}
+
+// Arctangent of a. Cephes' rational approximation, accurate to rounding
+inline Vec atan(Vec a) {
+    const Vec zero = set1(0.0);
+    const Vec one = set1(1.0);
+    Vec x = max(a, zero - a);
+    //Reduce to |x| <= tan(pi/8), with atan(x) = pi/2 - atan(1 / x), or pi/4 + atan((x - 1) / (x + 1))
+    Mask large = x > set1(2.414213562373095);
+    Mask medium = andnot(x > set1(0.66), large);
+    x = select(large, zero - one / x, select(medium, (x - one) / (x + one), x));
+    Vec z = x * x;
+    Vec p = fmadd(fmadd(fmadd(fmadd(set1(-8.750608600031904122785e-1), z, set1(-1.615753718733365076637e1)), z,
+        set1(-7.500855792314704667340e1)), z, set1(-1.228866684490136173410e2)), z, set1(-6.485021904942025371773e1));
+    Vec q = fmadd(fmadd(fmadd(fmadd(z + set1(2.485846490142306297962e1), z, set1(1.650270098316988542046e2)), z,
+        set1(4.328810604912902668951e2)), z, set1(4.853903996359136964868e2)), z, set1(1.945506571482613964425e2));
+    Vec r = fmadd(x, z * p / q, x);
+    //pi/2 and pi/4 each split in two, for the bits lost to rounding them
+    r = select(large, (r + set1(6.123233995736765886130e-17)) + set1(1.570796326794896619231),
+        select(medium, (r + set1(3.061616997868382943065e-17)) + set1(7.853981633974483096157e-1), r));
+    return select(a < zero, zero - r, r);
+}
+
+// Solves Vermeille's closed form for ECEF positions x, y, z. Sets D, the distance from the polar axis scaled to the
+// ellipsoid's evolute, and alt_scale, which scales the distance from the evolute to the altitude
+inline void solveGeodetic(Vec x, Vec y, Vec z, Vec& D, Vec& alt_scale) {
+    const double e2 = Earth::f * (2 - Earth::f);
+    const Vec one = set1(1.0);
+    const Vec v_e2 = set1(e2);
+    const Vec v_e4 = set1(e2 * e2);
+
+    Vec w2 = fmadd(x, x, y * y);
+    Vec p = w2 * set1(1 / (Earth::a * Earth::a));
+    Vec q = z * z * set1((1 - e2) / (Earth::a * Earth::a));
+    Vec r = (p + q - v_e4) * set1(1.0 / 6);
+    Vec s = v_e4 * p * q / (set1(4.0) * r * r * r);
+    //t = cbrt(A), and 1 / t = rcbrt(A)
+    Vec A = one + s + sqrt(s * (set1(2.0) + s));
+    Vec inv_t = rcbrtNearOne(A);
+    Vec u = r * (one + A * inv_t * inv_t + inv_t);
+    Vec v = sqrt(fmadd(u, u, v_e4 * q));
+    Vec w = v_e2 * (u + v - q) / (set1(2.0) * v);
+    Vec k = sqrt(fmadd(w, w, u + v)) - w;
+    //1 / k and 1 / (k + e^2) from a single division
+    Vec k_e2 = k + v_e2;
+    Vec inv = one / (k * k_e2);
+    D = k * k * sqrt(w2) * inv;
+    alt_scale = (k_e2 - one) * k_e2 * inv;
+}
+
+// Returns the geodetic altitude of ECEF positions x, y, z
+inline Vec geodeticAltitude(Vec x, Vec y, Vec z) {
+    Vec D, alt_scale;
+    solveGeodetic(x, y, z, D, alt_scale);
+    return alt_scale * sqrt(fmadd(D, D, z * z));
+}
+
+// Converts ECEF positions x, y, z to geodetic latitude and longitude, in radians, and altitude
+inline void geodeticLLA(Vec x, Vec y, Vec z, Vec& lat, Vec& lon, Vec& alt) {
+    const Vec zero = set1(0.0);
+    const Vec two = set1(2.0);
+    Vec D, alt_scale;
+    solveGeodetic(x, y, z, D, alt_scale);
+    Vec dz = sqrt(fmadd(D, D, z * z));
+    alt = alt_scale * dz;
+    //Half-angle forms of atan2. For longitude, the form without cancellation on either side of the y axis
+    lat = two * atan(z / (D + dz));
+    Vec w = sqrt(fmadd(x, x, y * y));
+    lon = two * atan(select(x < zero, (w - x) / y, y / (x + w)));
+    //On the polar axis, where longitude is undefined
+    lon = select(w > zero, lon, zero);
+}
+} // namespace simd
+} // namespace trajectorysim
@@ -0,0 +1,83 @@
+#include "stdafx.h"
+#include "IntegratorComparison.h"
+#include "Simulation.h"
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <memory>
+
+namespace trajectorysim {
+
+//Halvings of dT tried for each fixed-step integrator, and tolerances tried for the adaptive integrator
+static const int k_Halvings = 8;
+static const double k_Tolerances[] = { 1e-1, 1e-2, 1e-3, 1e-4, 1e-5, 1e-6, 1e-7 };
+//Tolerance of the reference run, well below any trial's
+static const double k_ReferenceTolerance = 1e-10;
+
+IntegratorTrial IntegratorComparison::runTrial(const Earth& earth, const RunCase& runCase, IntegratorSettings integrator, const RunLimits& limits, double dT, SolutionRecord& solution) {
+    std::unique_ptr<Projectile> projectile = Campaign::makeProjectile(runCase);
+    Simulation sim(earth, projectile.get(), dT, false, runCase.run_num);
+    sim.setIntegrator(integrator);
+    sim.setRunLimits(limits);
+    sim.run();
+    solution = sim.getSolution();
+    return IntegratorTrial{ integrator, dT, solution.steps, sim.getEvaluationCount(), 0, 0, solution.status };
+}
+
+std::vector<IntegratorTrial> IntegratorComparison::run(const Earth& earth, const RunCase& runCase, double maxDT, const IntegratorSettings& adaptive, const RunLimits& limits, RunStatus& reference_status) {
+    IntegratorSettings reference_settings{ IntegratorSettings::k_RK45, k_ReferenceTolerance, 0, adaptive.min_step };
+    SolutionRecord reference;
+    runTrial(earth, runCase, reference_settings, limits, maxDT, reference);
+    reference_status = reference.status;
+
+    std::vector<IntegratorTrial> trials;
+    if (reference_status != k_Impact) return trials;
+    auto addTrial = [&](IntegratorSettings integrator, const RunLimits& trialLimits, double dT) {
+        SolutionRecord solution;
+        IntegratorTrial trial = runTrial(earth, runCase, integrator, trialLimits, dT, solution);
+        if (solution.status != k_Impact) {
+            trial.impact_error = std::numeric_limits<double>::infinity();
+            trial.time_error = std::numeric_limits<double>::infinity();
+        }
+        else {
+            trial.impact_error = sqrt(pow(solution.pos.x - reference.pos.x, 2) + pow(solution.pos.y - reference.pos.y, 2) + pow(solution.pos.z - reference.pos.z, 2));
+            trial.time_error = fabs(solution.time - reference.time);
+        }
+        trials.push_back(trial);
+    };
+
+    for (int type = IntegratorSettings::k_ConstantAccel; type < IntegratorSettings::k_RK45; ++type) {
+        IntegratorSettings integrator = IntegratorSettings::defaults();
+        integrator.type = (IntegratorSettings::Type)type;
+        double dT = maxDT;
+        for (int i = 0; i < k_Halvings; ++i) {
+            addTrial(integrator, limits.scaledTo(dT, maxDT), dT);
+            dT /= 2;
+        }
+    }
+    //Tolerances are absolute only, so position in m and velocity in m/s are held to the same tolerance
+    for (double tolerance : k_Tolerances) {
+        addTrial(IntegratorSettings{ IntegratorSettings::k_RK45, tolerance, 0, adaptive.min_step }, limits, maxDT);
+    }
+    return trials;
+}
+
+const IntegratorTrial* IntegratorComparison::findCheapest(const std::vector<IntegratorTrial>& trials, double target) {
+    const IntegratorTrial* cheapest = nullptr;
+    for (const IntegratorTrial& trial : trials) {
+        if ((trial.impact_error <= target) && (!cheapest || (trial.evaluations < cheapest->evaluations))) cheapest = &trial;
+    }
+    return cheapest;
+}
+
+void IntegratorComparison::write(std::ostream& out, const std::vector<IntegratorTrial>& trials) {
+    out << "integrator, dT, abstol, steps, evaluations, impact error, time error, status" << std::endl;
+    out << std::setprecision(6);
+    for (const IntegratorTrial& trial : trials) {
+        out << IntegratorSettings::getName(trial.integrator.type) << "," << trial.dT << ",";
+        if (trial.integrator.type == IntegratorSettings::k_RK45) out << trial.integrator.abstol;
+        out << "," << trial.steps << "," << trial.evaluations << ",";
+        out << trial.impact_error << "," << trial.time_error << "," << Simulation::getStatusName(trial.status) << "\n";
+    }
+}
+} // namespace trajectorysim
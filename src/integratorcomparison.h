@@ -0,0 +1,50 @@
+#pragma once
+#include "Campaign.h"
+#include "Earth.h"
+#include "Integrators.h"
+#include "Simulation.h"
+#include <ostream>
+#include <vector>
+
+namespace trajectorysim {
+
+// Cost and accuracy of one integrator setting on a single run
+struct IntegratorTrial {
+    IntegratorSettings integrator;
+    // Fixed step, or first step of the adaptive integrator
+    double dT;
+    int steps;
+    // Evaluations of the acceleration, the dominant cost of a run
+    int evaluations;
+    // Distance of the impact point from the reference's, in m, and difference in impact time, in secs.
+    // Infinite if the run did not reach the ground
+    double impact_error;
+    double time_error;
+    // How the run ended
+    RunStatus status;
+};
+
+// Compares the integrators on a single run, so the one reaching a given impact accuracy with the fewest force
+// evaluations can be chosen for a campaign. Each fixed-step integrator is run at successively halved dT, and the
+// adaptive integrator at successively tighter tolerances, against a reference run of the adaptive integrator at
+// much tighter tolerances
+class IntegratorComparison
+{
+public:
+    // Runs every trial of runCase, with fixed steps halved from maxDT. min_step is taken from adaptive. limits are
+    // those of a run at maxDT, and their step limit is scaled with dT for each fixed-step trial.
+    // Sets reference_status to how the reference run ended. If it didn't reach the ground, there is nothing to
+    // compare to, and no trials are run
+    static std::vector<IntegratorTrial> run(const Earth& earth, const RunCase& runCase, double maxDT, const IntegratorSettings& adaptive, const RunLimits& limits, RunStatus& reference_status);
+
+    // Returns the trial meeting impact error target, in m, with the fewest evaluations, or nullptr if none does
+    static const IntegratorTrial* findCheapest(const std::vector<IntegratorTrial>& trials, double target);
+
+    // Writes trials as [prefix]integrators.csv
+    static void write(std::ostream& out, const std::vector<IntegratorTrial>& trials);
+
+private:
+    // Runs runCase with integrator and a (first) step of dT, returning its final state in solution
+    static IntegratorTrial runTrial(const Earth& earth, const RunCase& runCase, IntegratorSettings integrator, const RunLimits& limits, double dT, SolutionRecord& solution);
+};
+} // namespace trajectorysim
@@ -0,0 +1,26 @@
+#include "stdafx.h"
+#include "Integrators.h"
+
+namespace trajectorysim {
+
+IntegratorSettings IntegratorSettings::defaults() {
+    return IntegratorSettings{ k_ConstantAccel, 1e-3, 1e-9, 1e-3 };
+}
+
+// Command line names of the integrators, in Type order
+static const char* k_TypeNames[] = { "constaccel", "euler", "verlet", "heun", "rk4", "rk45" };
+
+bool IntegratorSettings::parseType(const std::string& name, Type& type) {
+    for (int i = 0; i <= k_RK45; ++i) {
+        if (name == k_TypeNames[i]) {
+            type = (Type)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string IntegratorSettings::getName(Type type) {
+    return k_TypeNames[type];
+}
+} // namespace trajectorysim
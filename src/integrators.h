@@ -0,0 +1,345 @@
+#pragma once
+#include "Earth.h"
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <string>
+
+namespace trajectorysim {
+
+// Position and velocity of a projectile, as advanced by an integrator
+struct State {
+    Earth::Coords pos;
+    Earth::Coords vel;
+};
+
+// Rate of change of a State: velocity, and acceleration
+struct Derivative {
+    Earth::Coords vel;
+    Earth::Coords accel;
+};
+
+// Path of the projectile over a step of the constant-acceleration update, which is exact for that update
+class ConstantAccelPath
+{
+public:
+    ConstantAccelPath(const State& start, const Earth::Coords& accel) : start(start), accel(accel) {}
+
+    // State t secs into the step
+    State at(double t) const {
+        double half_t2 = 0.5 * t * t;
+        return State{
+            Earth::Coords{ start.pos.x + start.vel.x * t + accel.x * half_t2,
+                           start.pos.y + start.vel.y * t + accel.y * half_t2,
+                           start.pos.z + start.vel.z * t + accel.z * half_t2 },
+            Earth::Coords{ start.vel.x + accel.x * t, start.vel.y + accel.y * t, start.vel.z + accel.z * t }
+        };
+    }
+
+private:
+    State start;
+    Earth::Coords accel;
+};
+
+// Dense output of a step: cubic Hermite interpolation between the states and derivatives at either end, so the
+// state anywhere within the step is known to 3rd order without further force evaluations
+class HermitePath
+{
+public:
+    HermitePath(const State& start, const Derivative& start_derivative, const State& end, const Derivative& end_derivative, double h)
+        : start(start), start_derivative(start_derivative), end(end), end_derivative(end_derivative), h(h) {}
+
+    // State t secs into the step
+    State at(double t) const {
+        double s = t / h;
+        double h00 = (1 + 2 * s) * (1 - s) * (1 - s);
+        double h10 = s * (1 - s) * (1 - s) * h;
+        double h01 = s * s * (3 - 2 * s);
+        double h11 = s * s * (s - 1) * h;
+        return State{
+            interpolate(start.pos, start_derivative.vel, end.pos, end_derivative.vel, h00, h10, h01, h11),
+            interpolate(start.vel, start_derivative.accel, end.vel, end_derivative.accel, h00, h10, h01, h11)
+        };
+    }
+
+private:
+    static Earth::Coords interpolate(const Earth::Coords& y0, const Earth::Coords& dy0, const Earth::Coords& y1, const Earth::Coords& dy1,
+                                     double h00, double h10, double h01, double h11) {
+        return Earth::Coords{
+            h00 * y0.x + h10 * dy0.x + h01 * y1.x + h11 * dy1.x,
+            h00 * y0.y + h10 * dy0.y + h01 * y1.y + h11 * dy1.y,
+            h00 * y0.z + h10 * dy0.z + h01 * y1.z + h11 * dy1.z
+        };
+    }
+
+    State start;
+    Derivative start_derivative;
+    State end;
+    Derivative end_derivative;
+    double h;
+};
+
+// Fixed-step integrators, used as compile-time strategies by Simulation. Each advances a state by a step of h secs,
+// given the acceleration at its start, calling accel(pos, vel) for any further acceleration evaluations it needs.
+// path() returns the state within the step, for locating events, evaluating the acceleration at its end if needed
+
+// The constant-acceleration update. Simulation keeps Projectile::updatePosition for it in ECEF, whose rounding
+// differs, so this is only used where there's no earlier output to match
+struct ConstantAccelStep {
+    template <typename AccelFunction>
+    static State step(const State& start, const Earth::Coords& a0, double h, AccelFunction&) {
+        return ConstantAccelPath(start, a0).at(h);
+    }
+
+    template <typename AccelFunction>
+    static ConstantAccelPath path(const State& start, const Earth::Coords& a0, const State&, double, AccelFunction&) {
+        return ConstantAccelPath(start, a0);
+    }
+};
+
+// Semi-implicit (symplectic) Euler: velocity updated first, then position with the new velocity. 1st order
+struct SemiImplicitEulerStep {
+    template <typename AccelFunction>
+    static State step(const State& start, const Earth::Coords& a0, double h, AccelFunction&) {
+        Earth::Coords vel{ start.vel.x + h * a0.x, start.vel.y + h * a0.y, start.vel.z + h * a0.z };
+        return State{ Earth::Coords{ start.pos.x + h * vel.x, start.pos.y + h * vel.y, start.pos.z + h * vel.z }, vel };
+    }
+
+    template <typename AccelFunction>
+    static HermitePath path(const State& start, const Earth::Coords& a0, const State& end, double h, AccelFunction& accel) {
+        return HermitePath(start, Derivative{ start.vel, a0 }, end, Derivative{ end.vel, accel(end.pos, end.vel) }, h);
+    }
+};
+
+// Velocity Verlet. As drag depends on velocity, the acceleration at the end of the step is evaluated at the velocity
+// predicted by an Euler step, then averaged with the start's. 2nd order
+struct VelocityVerletStep {
+    template <typename AccelFunction>
+    static State step(const State& start, const Earth::Coords& a0, double h, AccelFunction& accel) {
+        double half_h2 = 0.5 * h * h;
+        Earth::Coords pos{ start.pos.x + h * start.vel.x + half_h2 * a0.x,
+                           start.pos.y + h * start.vel.y + half_h2 * a0.y,
+                           start.pos.z + h * start.vel.z + half_h2 * a0.z };
+        Earth::Coords a1 = accel(pos, Earth::Coords{ start.vel.x + h * a0.x, start.vel.y + h * a0.y, start.vel.z + h * a0.z });
+        double half_h = 0.5 * h;
+        return State{ pos, Earth::Coords{ start.vel.x + half_h * (a0.x + a1.x),
+                                          start.vel.y + half_h * (a0.y + a1.y),
+                                          start.vel.z + half_h * (a0.z + a1.z) } };
+    }
+
+    template <typename AccelFunction>
+    static HermitePath path(const State& start, const Earth::Coords& a0, const State& end, double h, AccelFunction& accel) {
+        return SemiImplicitEulerStep::path(start, a0, end, h, accel);
+    }
+};
+
+// Heun's method: an Euler predictor, corrected with the average of the derivatives at either end. 2nd order
+struct HeunStep {
+    template <typename AccelFunction>
+    static State step(const State& start, const Earth::Coords& a0, double h, AccelFunction& accel) {
+        Earth::Coords pos{ start.pos.x + h * start.vel.x, start.pos.y + h * start.vel.y, start.pos.z + h * start.vel.z };
+        Earth::Coords vel{ start.vel.x + h * a0.x, start.vel.y + h * a0.y, start.vel.z + h * a0.z };
+        Earth::Coords a1 = accel(pos, vel);
+        double half_h = 0.5 * h;
+        return State{
+            Earth::Coords{ start.pos.x + half_h * (start.vel.x + vel.x),
+                           start.pos.y + half_h * (start.vel.y + vel.y),
+                           start.pos.z + half_h * (start.vel.z + vel.z) },
+            Earth::Coords{ start.vel.x + half_h * (a0.x + a1.x),
+                           start.vel.y + half_h * (a0.y + a1.y),
+                           start.vel.z + half_h * (a0.z + a1.z) }
+        };
+    }
+
+    template <typename AccelFunction>
+    static HermitePath path(const State& start, const Earth::Coords& a0, const State& end, double h, AccelFunction& accel) {
+        return SemiImplicitEulerStep::path(start, a0, end, h, accel);
+    }
+};
+
+// Classical 4th order Runge-Kutta
+struct RK4Step {
+    template <typename AccelFunction>
+    static State step(const State& start, const Earth::Coords& a0, double h, AccelFunction& accel) {
+        Derivative k1{ start.vel, a0 };
+        State s2 = advance(start, 0.5 * h, k1);
+        Derivative k2{ s2.vel, accel(s2.pos, s2.vel) };
+        State s3 = advance(start, 0.5 * h, k2);
+        Derivative k3{ s3.vel, accel(s3.pos, s3.vel) };
+        State s4 = advance(start, h, k3);
+        Derivative k4{ s4.vel, accel(s4.pos, s4.vel) };
+        double sixth_h = h / 6;
+        return State{
+            Earth::Coords{ start.pos.x + sixth_h * (k1.vel.x + 2 * (k2.vel.x + k3.vel.x) + k4.vel.x),
+                           start.pos.y + sixth_h * (k1.vel.y + 2 * (k2.vel.y + k3.vel.y) + k4.vel.y),
+                           start.pos.z + sixth_h * (k1.vel.z + 2 * (k2.vel.z + k3.vel.z) + k4.vel.z) },
+            Earth::Coords{ start.vel.x + sixth_h * (k1.accel.x + 2 * (k2.accel.x + k3.accel.x) + k4.accel.x),
+                           start.vel.y + sixth_h * (k1.accel.y + 2 * (k2.accel.y + k3.accel.y) + k4.accel.y),
+                           start.vel.z + sixth_h * (k1.accel.z + 2 * (k2.accel.z + k3.accel.z) + k4.accel.z) }
+        };
+    }
+
+    template <typename AccelFunction>
+    static HermitePath path(const State& start, const Earth::Coords& a0, const State& end, double h, AccelFunction& accel) {
+        return SemiImplicitEulerStep::path(start, a0, end, h, accel);
+    }
+
+private:
+    // Returns state + h * derivative
+    static State advance(const State& state, double h, const Derivative& derivative) {
+        return State{
+            Earth::Coords{ state.pos.x + h * derivative.vel.x, state.pos.y + h * derivative.vel.y, state.pos.z + h * derivative.vel.z },
+            Earth::Coords{ state.vel.x + h * derivative.accel.x, state.vel.y + h * derivative.accel.y, state.vel.z + h * derivative.accel.z }
+        };
+    }
+};
+
+// Selects the integrator used by Simulation, and its settings
+struct IntegratorSettings {
+    enum Type {
+        // Fixed dT, with the constant-acceleration update of Projectile::updatePosition
+        k_ConstantAccel,
+        // Fixed dT, with the integrator of the same name
+        k_SemiImplicitEuler,
+        k_VelocityVerlet,
+        k_Heun,
+        k_RK4,
+        // Adaptive Dormand-Prince 5(4), with dT as the first step
+        k_RK45
+    };
+
+    Type type;
+    // Error tolerances of adaptive integrators. Each step keeps the estimated error of every position and velocity
+    // component, relative to abstol + reltol * |component|, below 1 in RMS
+    double abstol;
+    double reltol;
+    // Smallest step adaptive integrators take, in secs. Steps this short are accepted even if their error is over
+    // tolerance, which happens where forces are discontinuous, such as the drag coefficient's jump at Mach 1, as
+    // otherwise a run sliding along the discontinuity would take ever shorter steps
+    double min_step;
+
+    // Returns the default settings, using the constant-acceleration update
+    static IntegratorSettings defaults();
+
+    // Sets type from its command line name. Returns false if name is not recognised
+    static bool parseType(const std::string& name, Type& type);
+
+    // Returns the command line name of type
+    static std::string getName(Type type);
+};
+
+// Embedded Runge-Kutta pair of Dormand and Prince: a 5th order step, with the difference from a 4th order step as its
+// error estimate, used to pick the step size that keeps the error within tolerance. Takes long steps where forces
+// vary slowly, such as coasting through near vacuum, and short ones in dense air.
+// The last stage of a step is the derivative at its end, so is reused as the first stage of the next (FSAL), for six
+// acceleration evaluations per step. AccelFunction is called as accel(pos, vel), returning the acceleration there.
+class DormandPrince
+{
+public:
+    DormandPrince(double abstol, double reltol, double min_step) {
+        DormandPrince::abstol = abstol;
+        DormandPrince::reltol = reltol;
+        DormandPrince::min_step = min_step;
+        rejected = false;
+    }
+
+    // Starts integrating from state, evaluating the derivative there
+    template <typename AccelFunction>
+    void start(const State& state, AccelFunction& accel) {
+        derivative = Derivative{ state.vel, accel(state.pos, state.vel) };
+    }
+
+    // Attempts a step of h secs from state. If the error is within tolerance, or h is already the minimum step, advances
+    // state and returns true. Otherwise leaves state unchanged and returns false. Either way, h is set to the step size
+    // to try next
+    template <typename AccelFunction>
+    bool step(State& state, double& h, AccelFunction& accel) {
+        static const double a21 = 1.0 / 5;
+        static const double a31 = 3.0 / 40, a32 = 9.0 / 40;
+        static const double a41 = 44.0 / 45, a42 = -56.0 / 15, a43 = 32.0 / 9;
+        static const double a51 = 19372.0 / 6561, a52 = -25360.0 / 2187, a53 = 64448.0 / 6561, a54 = -212.0 / 729;
+        static const double a61 = 9017.0 / 3168, a62 = -355.0 / 33, a63 = 46732.0 / 5247, a64 = 49.0 / 176, a65 = -5103.0 / 18656;
+        static const double b1 = 35.0 / 384, b3 = 500.0 / 1113, b4 = 125.0 / 192, b5 = -2187.0 / 6784, b6 = 11.0 / 84;
+        //Differences between the 5th and 4th order weights
+        static const double e1 = 71.0 / 57600, e3 = -71.0 / 16695, e4 = 71.0 / 1920, e5 = -17253.0 / 339200, e6 = 22.0 / 525, e7 = -1.0 / 40;
+
+        const Derivative& k1 = derivative;
+        Derivative k2 = evaluate(state, h, accel, { a21 }, { &k1 });
+        Derivative k3 = evaluate(state, h, accel, { a31, a32 }, { &k1, &k2 });
+        Derivative k4 = evaluate(state, h, accel, { a41, a42, a43 }, { &k1, &k2, &k3 });
+        Derivative k5 = evaluate(state, h, accel, { a51, a52, a53, a54 }, { &k1, &k2, &k3, &k4 });
+        Derivative k6 = evaluate(state, h, accel, { a61, a62, a63, a64, a65 }, { &k1, &k2, &k3, &k4, &k5 });
+        State next = combine(state, h, { b1, b3, b4, b5, b6 }, { &k1, &k3, &k4, &k5, &k6 });
+        Derivative k7{ next.vel, accel(next.pos, next.vel) };
+
+        State error = combine(State{}, h, { e1, e3, e4, e5, e6, e7 }, { &k1, &k3, &k4, &k5, &k6, &k7 });
+        double sum = errorTerm(error.pos.x, state.pos.x, next.pos.x) + errorTerm(error.pos.y, state.pos.y, next.pos.y) +
+                     errorTerm(error.pos.z, state.pos.z, next.pos.z) + errorTerm(error.vel.x, state.vel.x, next.vel.x) +
+                     errorTerm(error.vel.y, state.vel.y, next.vel.y) + errorTerm(error.vel.z, state.vel.z, next.vel.z);
+        double err = sqrt(sum / 6);
+
+        //Scale the step towards the size that would just meet the tolerance, with a safety factor. A NaN error
+        //shrinks the step as far as allowed
+        double factor = (err > 0) ? 0.9 * pow(err, -0.2) : 5.0;
+        if (!(err <= 1) && (h > min_step)) {
+            h = std::max(h * std::max(0.2, std::min(factor, 1.0)), min_step);
+            rejected = true;
+            return false;
+        }
+        previous = state;
+        previous_derivative = derivative;
+        state = next;
+        derivative = k7;
+        //Don't grow the step straight after a rejection, which would likely be rejected again
+        h = std::max(h * std::max(0.2, std::min(factor, rejected ? 1.0 : 5.0)), min_step);
+        rejected = false;
+        return true;
+    }
+
+    // Derivative at the current state
+    const Derivative& getDerivative() const { return derivative; }
+
+    // State and derivative at the start of the last accepted step
+    const State& getPrevious() const { return previous; }
+    const Derivative& getPreviousDerivative() const { return previous_derivative; }
+
+private:
+    // Derivative at state + h * sum(weights[i] * stages[i])
+    template <typename AccelFunction>
+    static Derivative evaluate(const State& state, double h, AccelFunction& accel,
+                               std::initializer_list<double> weights, std::initializer_list<const Derivative*> stages) {
+        State stage = combine(state, h, weights, stages);
+        return Derivative{ stage.vel, accel(stage.pos, stage.vel) };
+    }
+
+    // Returns state + h * sum(weights[i] * stages[i])
+    static State combine(State state, double h, std::initializer_list<double> weights, std::initializer_list<const Derivative*> stages) {
+        const double* weight = weights.begin();
+        for (const Derivative* stage : stages) {
+            double hw = h * *weight++;
+            state.pos.x += hw * stage->vel.x;
+            state.pos.y += hw * stage->vel.y;
+            state.pos.z += hw * stage->vel.z;
+            state.vel.x += hw * stage->accel.x;
+            state.vel.y += hw * stage->accel.y;
+            state.vel.z += hw * stage->accel.z;
+        }
+        return state;
+    }
+
+    // Squared error of a component, relative to its tolerance
+    double errorTerm(double error, double before, double after) const {
+        double scaled = error / (abstol + reltol * std::max(std::abs(before), std::abs(after)));
+        return scaled * scaled;
+    }
+
+    double abstol;
+    double reltol;
+    double min_step;
+    // Set if the last step attempted was rejected
+    bool rejected;
+    Derivative derivative;
+    State previous;
+    Derivative previous_derivative;
+};
+} // namespace trajectorysim
@@ -0,0 +1,106 @@
+#include "stdafx.h"
+#include "KeplerOrbit.h"
+#include <algorithm>
+#include <cmath>
+
+namespace trajectorysim {
+
+KeplerOrbit::KeplerOrbit(const State& start, double mu) {
+    KeplerOrbit::start = start;
+    KeplerOrbit::mu = mu;
+    sqrt_mu = sqrt(mu);
+    r0 = sqrt(pow(start.pos.x, 2) + pow(start.pos.y, 2) + pow(start.pos.z, 2));
+    vr0 = (start.pos.x * start.vel.x + start.pos.y * start.vel.y + start.pos.z * start.vel.z) / r0;
+    double v2 = pow(start.vel.x, 2) + pow(start.vel.y, 2) + pow(start.vel.z, 2);
+    alpha = 2 / r0 - v2 / mu;
+}
+
+double KeplerOrbit::stumpffC(double z) {
+    //Series near 0, where the closed forms cancel
+    if (std::abs(z) < 1e-3) return 0.5 - z / 24 + z * z / 720;
+    if (z > 0) return (1 - cos(sqrt(z))) / z;
+    return (cosh(sqrt(-z)) - 1) / -z;
+}
+
+double KeplerOrbit::stumpffS(double z) {
+    if (std::abs(z) < 1e-3) return 1.0 / 6 - z / 120 + z * z / 5040;
+    if (z > 0) {
+        double s = sqrt(z);
+        return (s - sin(s)) / (s * s * s);
+    }
+    double s = sqrt(-z);
+    return (sinh(s) - s) / (s * s * s);
+}
+
+State KeplerOrbit::at(double t) const {
+    //Solve the universal Kepler equation for chi by Newton's method
+    double chi = sqrt_mu * std::abs(alpha) * t;
+    for (int iteration = 0; iteration < 50; ++iteration) {
+        double z = alpha * chi * chi;
+        double C = stumpffC(z);
+        double S = stumpffS(z);
+        double F = r0 * vr0 / sqrt_mu * chi * chi * C + (1 - alpha * r0) * chi * chi * chi * S + r0 * chi - sqrt_mu * t;
+        double dF = r0 * vr0 / sqrt_mu * chi * (1 - z * S) + (1 - alpha * r0) * chi * chi * C + r0;
+        double delta = F / dF;
+        chi -= delta;
+        if (std::abs(delta) <= 1e-13 * std::max(std::abs(chi), 1.0)) break;
+    }
+
+    //Lagrange coefficients
+    double z = alpha * chi * chi;
+    double C = stumpffC(z);
+    double S = stumpffS(z);
+    double f = 1 - chi * chi / r0 * C;
+    double g = t - chi * chi * chi * S / sqrt_mu;
+    Earth::Coords pos{
+        f * start.pos.x + g * start.vel.x,
+        f * start.pos.y + g * start.vel.y,
+        f * start.pos.z + g * start.vel.z
+    };
+    double r = sqrt(pow(pos.x, 2) + pow(pos.y, 2) + pow(pos.z, 2));
+    double fdot = sqrt_mu / (r * r0) * (z * chi * S - chi);
+    double gdot = 1 - chi * chi / r * C;
+    return State{
+        pos,
+        Earth::Coords{
+            fdot * start.pos.x + gdot * start.vel.x,
+            fdot * start.pos.y + gdot * start.vel.y,
+            fdot * start.pos.z + gdot * start.vel.z
+        }
+    };
+}
+
+bool KeplerOrbit::getDescent(double& begin, double& end) const {
+    //Eccentricity from the energy and angular momentum
+    double v2 = pow(start.vel.x, 2) + pow(start.vel.y, 2) + pow(start.vel.z, 2);
+    double h2 = r0 * r0 * v2 - pow(r0 * vr0, 2);
+    double ecc = sqrt(std::max(0.0, 1 - h2 * alpha / mu));
+    if (ecc < 1e-9) return false;
+
+    if (alpha > 0) {
+        //Elliptic. Mean anomaly from the eccentric anomaly, negative while descending to periapsis
+        const double k_PI = 3.14159265359;
+        double n = sqrt(mu * alpha * alpha * alpha);
+        double E = acos(std::min(1.0, std::max(-1.0, (1 - r0 * alpha) / ecc)));
+        if (vr0 < 0) E = -E;
+        double M = E - ecc * sin(E);
+        if (vr0 < 0) {
+            begin = 0;
+            end = -M / n;
+        }
+        else {
+            begin = (k_PI - M) / n;
+            end = (2 * k_PI - M) / n;
+        }
+        return true;
+    }
+    //Hyperbolic, or parabolic, so descends only if it already is
+    if ((vr0 >= 0) || (alpha == 0)) return false;
+    double n = sqrt(mu * -alpha * alpha * alpha);
+    double F = -acosh(std::max(1.0, (1 - r0 * alpha) / ecc));
+    double M = ecc * sinh(F) - F;
+    begin = 0;
+    end = -M / n;
+    return true;
+}
+} // namespace trajectorysim
@@ -0,0 +1,35 @@
+#pragma once
+#include "Earth.h"
+#include "Integrators.h"
+
+namespace trajectorysim {
+
+// Drag-free two-body orbit about the centre of the Earth, propagated analytically with universal variables, so
+// elliptic and hyperbolic orbits are handled alike. mu is the gravitational parameter, in m^3/s^2
+class KeplerOrbit
+{
+public:
+    KeplerOrbit(const State& start, double mu);
+
+    // State t secs after the start
+    State at(double t) const;
+
+    // Returns the times of the next descending part of the orbit, from the start, or apoapsis if still ascending,
+    // to periapsis. Returns false if the orbit doesn't descend: escaping, or circular
+    bool getDescent(double& begin, double& end) const;
+
+private:
+    // Stumpff functions C(z) and S(z)
+    static double stumpffC(double z);
+    static double stumpffS(double z);
+
+    State start;
+    double mu;
+    double sqrt_mu;
+    // Start radius, and radial velocity
+    double r0;
+    double vr0;
+    // Reciprocal of the semi-major axis, negative for hyperbolic orbits
+    double alpha;
+};
+} // namespace trajectorysim
@@ -0,0 +1,66 @@
+#include "stdafx.h"
+#include "LocalTangentPlane.h"
+#include <cmath>
+
+namespace trajectorysim {
+
+LocalTangentPlane::LocalTangentPlane(Earth::LatLonAlt anchor) {
+    const double k_PI = 3.14159265359;
+    double rad_lat = anchor.lat * k_PI / 180.0;
+    double rad_lon = anchor.lon * k_PI / 180.0;
+
+    origin = Earth::LatLonAltToECEF(Earth::LatLonAlt{ anchor.lat, anchor.lon, 0 });
+    east = Earth::Coords{ -sin(rad_lon), cos(rad_lon), 0 };
+    north = Earth::Coords{ -sin(rad_lat) * cos(rad_lon), -sin(rad_lat) * sin(rad_lon), cos(rad_lat) };
+    //Normal to the ellipsoid, as used for altitude by Earth::LatLonAltToECEF
+    up = Earth::Coords{ cos(rad_lat) * cos(rad_lon), cos(rad_lat) * sin(rad_lon), sin(rad_lat) };
+}
+
+Earth::Coords LocalTangentPlane::toECEFVector(const Earth::Coords& enu) const {
+    return Earth::Coords{
+        enu.x * east.x + enu.y * north.x + enu.z * up.x,
+        enu.x * east.y + enu.y * north.y + enu.z * up.y,
+        enu.x * east.z + enu.y * north.z + enu.z * up.z
+    };
+}
+
+Earth::Coords LocalTangentPlane::fromECEFVector(const Earth::Coords& ecef) const {
+    return Earth::Coords{
+        ecef.x * east.x + ecef.y * east.y + ecef.z * east.z,
+        ecef.x * north.x + ecef.y * north.y + ecef.z * north.z,
+        ecef.x * up.x + ecef.y * up.y + ecef.z * up.z
+    };
+}
+
+Earth::Coords LocalTangentPlane::toECEF(const Earth::Coords& enu) const {
+    Earth::Coords offset = toECEFVector(enu);
+    return Earth::Coords{ origin.x + offset.x, origin.y + offset.y, origin.z + offset.z };
+}
+
+Earth::Coords LocalTangentPlane::fromECEF(const Earth::Coords& ecef) const {
+    return fromECEFVector(Earth::Coords{ ecef.x - origin.x, ecef.y - origin.y, ecef.z - origin.z });
+}
+
+Earth::Coords LocalTangentPlane::toGround(const Earth::Coords& enu) const {
+    //The plane is above the ellipsoid away from the anchor, so drop down to it along up, which is close to the
+    //local vertical within the flat earth limits. Converges in a step or two
+    Earth::Coords pos = toECEF(Earth::Coords{ enu.x, enu.y, 0 });
+    for (int iteration = 0; iteration < 5; ++iteration) {
+        double altitude = Earth::ECEFToAlt(pos);
+        if (altitude <= 0) break;
+        //Slightly past the ground, so the run is still seen to have ended
+        altitude += 1e-6;
+        pos = Earth::Coords{ pos.x - altitude * up.x, pos.y - altitude * up.y, pos.z - altitude * up.z };
+    }
+    return pos;
+}
+
+double LocalTangentPlane::getRange(const Earth::Coords& enu) {
+    return sqrt(enu.x * enu.x + enu.y * enu.y);
+}
+
+Earth::Coords LocalTangentPlane::getGravityDirection() const {
+    double r = sqrt(origin.x * origin.x + origin.y * origin.y + origin.z * origin.z);
+    return fromECEFVector(Earth::Coords{ -origin.x / r, -origin.y / r, -origin.z / r });
+}
+} // namespace trajectorysim
@@ -0,0 +1,48 @@
+#pragma once
+#include "Earth.h"
+
+namespace trajectorysim {
+
+// Limits of flat earth propagation. Beyond them, curvature of the earth is no longer negligible, so runs continue in ECEF
+struct FlatEarthSettings {
+    bool enabled;
+    // Horizontal distance from the anchor, in m. The ground falls away from the plane by about range^2 / (2 * a),
+    // 8 m at 10 km
+    double max_range;
+    // Altitude, in m
+    double max_alt;
+};
+
+// East-north-up frame in the plane tangent to the ellipsoid below an anchor point. Flat earth propagation treats
+// up as altitude, and gravity as acting in a fixed direction
+class LocalTangentPlane
+{
+public:
+    // Anchors the plane on the ellipsoid, at anchor's latitude and longitude
+    LocalTangentPlane(Earth::LatLonAlt anchor);
+
+    // Converts between positions in ECEF and the plane
+    Earth::Coords toECEF(const Earth::Coords& enu) const;
+    Earth::Coords fromECEF(const Earth::Coords& ecef) const;
+
+    // Converts between vectors, such as velocities, in ECEF and the plane
+    Earth::Coords toECEFVector(const Earth::Coords& enu) const;
+    Earth::Coords fromECEFVector(const Earth::Coords& ecef) const;
+
+    // Returns the ECEF point on or just below the ellipsoid, below a point on the plane
+    Earth::Coords toGround(const Earth::Coords& enu) const;
+
+    // Returns the horizontal distance of a point on the plane from the anchor
+    static double getRange(const Earth::Coords& enu);
+
+    // Returns the unit vector from the anchor towards the centre of the earth, the direction of Earth::Gravity_Accel.
+    // It's tilted from down, the normal to the ellipsoid, by the difference of geocentric and geodetic latitude
+    Earth::Coords getGravityDirection() const;
+
+private:
+    Earth::Coords origin;
+    Earth::Coords east;
+    Earth::Coords north;
+    Earth::Coords up;
+};
+} // namespace trajectorysim
@@ -0,0 +1,84 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace trajectorysim {
+
+// Bounded lock-free queue for many producer threads and a single consumer thread. A ring of cells, each tagged with a
+// sequence number that tells producers and the consumer whose turn it is to use the cell, so neither side ever locks.
+// When the ring is full push() waits for the consumer to free a cell, giving backpressure to producers that outpace it.
+template <typename T>
+class MpscQueue
+{
+public:
+    // capacity is rounded up to a power of two
+    explicit MpscQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity) size *= 2;
+        mask = size - 1;
+        cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+        enqueue_pos.store(0, std::memory_order_relaxed);
+        dequeue_pos = 0;
+    }
+
+    // Adds value to the queue. Returns false, leaving value untouched, if the queue is full
+    bool tryPush(T& value) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                //Cell is free for this position. Claim the position, unless another producer got there first
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) {
+                //Cell still holds a value from the previous lap, which the consumer hasn't taken yet
+                return false;
+            }
+            else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Adds value to the queue, waiting for the consumer to make room if the queue is full
+    void push(T value) {
+        while (!tryPush(value)) std::this_thread::yield();
+    }
+
+    // Takes the oldest value from the queue. Returns false if the queue is empty. Must only be called by one thread
+    bool tryPop(T& value) {
+        Cell* cell = &cells[dequeue_pos & mask];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        if ((intptr_t)sequence - (intptr_t)(dequeue_pos + 1) < 0) return false;
+        value = std::move(cell->value);
+        //Hand the cell back to producers for its next lap around the ring
+        cell->sequence.store(dequeue_pos + mask + 1, std::memory_order_release);
+        ++dequeue_pos;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    // Producer and consumer positions are kept on separate cache lines
+    alignas(64) std::atomic<size_t> enqueue_pos;
+    alignas(64) size_t dequeue_pos;
+};
+} // namespace trajectorysim
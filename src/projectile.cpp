@@ -52,30 +52,25 @@ void Projectile::updatePosition(Earth::Coords accel, double dT) {
     altitude = Earth::ECEFToAlt(Pos_ECEF);
 }
 
+void Projectile::setState(Earth::Coords position, Earth::Coords velocity) {
+    Pos_ECEF = position;
+    vel_ECEF = velocity;
+    altitude = Earth::ECEFToAlt(Pos_ECEF);
+}
+
 double Projectile::getDragCoeff(bool subsonic) {
     //May incorporate reynolds number in future. For now, just use a constant value
     if (subsonic) return Cd_subsonic;
     else return Cd_supersonic;
 }
 
-Earth::Coords Projectile::GetDragAccel(double density, bool subsonic, double area) {
-    Earth::Coords a_drag;
-
-    double a_drag_mag = -(getDragCoeff(subsonic) * area * density * pow(GetVelMag(), 2) / 2) / mass;
-
-    double abs_vel = GetVelMag();
-    double alpha = acos(vel_ECEF.x / abs_vel);
-    double beta = acos(vel_ECEF.y / abs_vel);
-    double gamma = acos(vel_ECEF.z / abs_vel);
-
-    a_drag.x = cos(alpha) * a_drag_mag;
-    a_drag.y = cos(beta) * a_drag_mag;
-    a_drag.z = cos(gamma) * a_drag_mag;
-
-    return a_drag;
+Earth::Coords Projectile::GetDragAccel(const DerivedState& state) {
+    double a_drag_mag = -(getDragCoeff(state.isSubsonic()) * getFrontalArea() * state.dynamic_pressure) / mass;
+    return Earth::Coords{ state.heading.x * a_drag_mag, state.heading.y * a_drag_mag, state.heading.z * a_drag_mag };
 }
 
 double Projectile::getAltitude() { return altitude; }
+Earth::LatLonAlt Projectile::getLatLonAlt() { return Earth::ECEFToLLA(Pos_ECEF); }
 double Projectile::getMass() { return mass; }
 double Projectile::getFrontalArea() { return 0; }
 void Projectile::setAltitude(double altitude) { Projectile::altitude = altitude; }
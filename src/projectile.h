@@ -1,5 +1,7 @@
 #pragma once
+#include "DerivedState.h"
 #include "Earth.h"
+#include <string>
 
 namespace trajectorysim {
 
@@ -22,12 +24,18 @@ public:
     // Updates the current position of the projectile
     void updatePosition(Earth::Coords accel, double dT);
 
+    // Sets the position and velocity of the projectile, as advanced by an integrator
+    void setState(Earth::Coords position, Earth::Coords velocity);
+
     // Returns the drag coefficient
     double getDragCoeff(bool subsonic);
 
-    // Returns acceleration on the projectile due to drag
-    Earth::Coords GetDragAccel(double density, bool subsonic, double area);
+    // Returns acceleration on the projectile due to drag, opposing its velocity
+    Earth::Coords GetDragAccel(const DerivedState& state);
     double getAltitude();
+
+    // Returns the geodetic coords of the current position
+    Earth::LatLonAlt getLatLonAlt();
     double getMass();
 
     // Returns frontal area used in drag calculations
@@ -0,0 +1,73 @@
+#include "stdafx.h"
+#include "RandomStream.h"
+#include <cmath>
+
+namespace trajectorysim {
+
+static const uint32_t k_PhiloxM0 = 0xD2511F53;
+static const uint32_t k_PhiloxM1 = 0xCD9E8D57;
+static const uint32_t k_PhiloxW0 = 0x9E3779B9;
+static const uint32_t k_PhiloxW1 = 0xBB67AE85;
+
+RandomStream::RandomStream(uint64_t seed, uint64_t run_num, uint32_t parameter)
+{
+    key[0] = (uint32_t)seed;
+    key[1] = (uint32_t)(seed >> 32);
+    //Word 3 of the counter is the draw index within the stream
+    counter[0] = (uint32_t)run_num;
+    counter[1] = (uint32_t)(run_num >> 32);
+    counter[2] = parameter;
+    counter[3] = 0;
+    block_index = 4;
+    has_spare_normal = false;
+    spare_normal = 0;
+}
+
+void RandomStream::philox(uint32_t counter[4], const uint32_t key[2]) {
+    uint32_t k0 = key[0];
+    uint32_t k1 = key[1];
+    for (int round = 0; round < 10; ++round) {
+        uint64_t product0 = (uint64_t)k_PhiloxM0 * counter[0];
+        uint64_t product1 = (uint64_t)k_PhiloxM1 * counter[2];
+        uint32_t hi0 = (uint32_t)(product0 >> 32), lo0 = (uint32_t)product0;
+        uint32_t hi1 = (uint32_t)(product1 >> 32), lo1 = (uint32_t)product1;
+        counter[0] = hi1 ^ counter[1] ^ k0;
+        counter[1] = lo1;
+        counter[2] = hi0 ^ counter[3] ^ k1;
+        counter[3] = lo0;
+        k0 += k_PhiloxW0;
+        k1 += k_PhiloxW1;
+    }
+}
+
+uint64_t RandomStream::next64() {
+    if (block_index >= 4) {
+        for (int i = 0; i < 4; ++i) block[i] = counter[i];
+        philox(block, key);
+        ++counter[3];
+        block_index = 0;
+    }
+    uint64_t output = ((uint64_t)block[block_index] << 32) | block[block_index + 1];
+    block_index += 2;
+    return output;
+}
+
+double RandomStream::uniform() {
+    //Top 53 bits, offset by half a step so 0 and 1 are never returned
+    return ((next64() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+double RandomStream::normal() {
+    //Box-Muller transform. Generates normals in pairs, so keep the second for the next call
+    if (has_spare_normal) {
+        has_spare_normal = false;
+        return spare_normal;
+    }
+    const double k_PI = 3.14159265358979323846;
+    double radius = sqrt(-2.0 * log(uniform()));
+    double angle = 2.0 * k_PI * uniform();
+    spare_normal = radius * sin(angle);
+    has_spare_normal = true;
+    return radius * cos(angle);
+}
+} // namespace trajectorysim
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+
+namespace trajectorysim {
+
+// Counter-based random number generator, using the Philox4x32-10 block function.
+// Each stream is keyed by (seed, run number, parameter id), and the n-th draw of a stream is a pure function of
+// those keys and n. Any run's random inputs can therefore be generated in O(1), independently of every other run,
+// and are identical regardless of which thread generates them or in what order.
+class RandomStream
+{
+public:
+    RandomStream(uint64_t seed, uint64_t run_num, uint32_t parameter);
+
+    // Returns a double uniformly distributed in the open interval (0, 1)
+    double uniform();
+
+    // Returns a normally distributed double with zero mean and unit standard deviation
+    double normal();
+
+    // Philox4x32-10 block function. Encrypts counter with key, returning the result in counter
+    static void philox(uint32_t counter[4], const uint32_t key[2]);
+
+private:
+    // Returns the next 64 random bits, generating a new block when the current one is used up
+    uint64_t next64();
+
+    uint32_t key[2];
+    uint32_t counter[4];
+    uint32_t block[4];
+    int block_index;
+    bool has_spare_normal;
+    double spare_normal;
+};
+} // namespace trajectorysim
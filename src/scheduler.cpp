@@ -0,0 +1,75 @@
+#include "stdafx.h"
+#include "Scheduler.h"
+
+namespace trajectorysim {
+
+Scheduler::Scheduler(int workerCount)
+    : queues(workerCount > 0 ? workerCount : 1)
+{
+    for (auto& queue : queues) {
+        queue.busy_time = 0;
+        queue.steals = 0;
+    }
+}
+
+void Scheduler::assign(const std::vector<int>& runs) {
+    for (size_t i = 0; i < runs.size(); ++i) {
+        WorkerQueue& queue = queues[i % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.runs.push_back(runs[i]);
+    }
+}
+
+bool Scheduler::next(int worker, int& run) {
+    {
+        WorkerQueue& own = queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.runs.empty()) {
+            run = own.runs.front();
+            own.runs.pop_front();
+            return true;
+        }
+    }
+    //Own deque is empty. Steal from the back of the others' deques, where their latest (with ordering, shortest) runs are
+    bool stolen = false;
+    for (size_t i = 1; !stolen && (i < queues.size()); ++i) {
+        WorkerQueue& victim = queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.runs.empty()) {
+            run = victim.runs.back();
+            victim.runs.pop_back();
+            stolen = true;
+        }
+    }
+    //Only ever hold one deque's lock at a time, so two workers stealing from each other can't deadlock
+    if (stolen) {
+        std::lock_guard<std::mutex> lock(queues[worker].mutex);
+        ++queues[worker].steals;
+    }
+    return stolen;
+}
+
+void Scheduler::setBusyTime(int worker, double secs) {
+    std::lock_guard<std::mutex> lock(queues[worker].mutex);
+    queues[worker].busy_time = secs;
+}
+
+double Scheduler::getEfficiency(double makespan) {
+    if (makespan <= 0) return 1.0;
+    double busy = 0;
+    for (auto& queue : queues) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        busy += queue.busy_time;
+    }
+    return busy / (queues.size() * makespan);
+}
+
+long long Scheduler::getStealCount() {
+    long long steals = 0;
+    for (auto& queue : queues) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        steals += queue.steals;
+    }
+    return steals;
+}
+} // namespace trajectorysim
@@ -0,0 +1,43 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace trajectorysim {
+
+// Work-stealing scheduler for campaign runs. Each worker thread has its own deque of run numbers, and takes runs from
+// the front of it. A worker whose deque is empty steals from the back of another worker's deque, so no worker sits
+// idle while runs remain anywhere, however unevenly run lengths are spread.
+class Scheduler
+{
+public:
+    Scheduler(int workerCount);
+
+    // Deals runs out to the workers round-robin, in the order given, so each worker starts its earliest runs first
+    void assign(const std::vector<int>& runs);
+
+    // Takes the next run for worker, stealing one if its own deque is empty. Returns false once every deque is empty
+    bool next(int worker, int& run);
+
+    // Records the time in secs that worker spent running, from the campaign's start until it ran out of runs
+    void setBusyTime(int worker, double secs);
+
+    // Returns the load-balance efficiency of the campaign: total busy time over (workers * makespan).
+    // 1.0 means every worker was busy until the last run finished
+    double getEfficiency(double makespan);
+
+    // Returns the number of runs taken from another worker's deque
+    long long getStealCount();
+
+private:
+    // Deques are padded to separate cache lines, so workers taking their own runs don't contend
+    struct alignas(64) WorkerQueue {
+        std::mutex mutex;
+        std::deque<int> runs;
+        double busy_time;
+        long long steals;
+    };
+
+    std::vector<WorkerQueue> queues;
+};
+} // namespace trajectorysim
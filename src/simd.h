@@ -0,0 +1,122 @@
+#pragma once
+// simd.h : Thin wrapper over the vector instruction set the project is compiled for, so batched kernels can be written
+// once. AVX-512 is used when __AVX512F__ is defined (/arch:AVX512, -mavx512f), AVX2 when __AVX2__ is defined
+// (/arch:AVX2, -mavx2 -mfma), and otherwise every operation falls back to plain scalar doubles.
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include <cmath>
+#include <bitset>
+
+namespace trajectorysim {
+namespace simd {
+
+#if defined(__AVX512F__)
+
+const int k_Width = 8;
+inline const char* name() { return "AVX-512"; }
+
+struct Vec { __m512d v; };
+struct Mask { __mmask8 m; };
+
+inline Vec set1(double x) { return Vec{ _mm512_set1_pd(x) }; }
+inline Vec load(const double* p) { return Vec{ _mm512_loadu_pd(p) }; }
+inline void store(double* p, Vec a) { _mm512_storeu_pd(p, a.v); }
+inline Vec operator+(Vec a, Vec b) { return Vec{ _mm512_add_pd(a.v, b.v) }; }
+inline Vec operator-(Vec a, Vec b) { return Vec{ _mm512_sub_pd(a.v, b.v) }; }
+inline Vec operator*(Vec a, Vec b) { return Vec{ _mm512_mul_pd(a.v, b.v) }; }
+inline Vec operator/(Vec a, Vec b) { return Vec{ _mm512_div_pd(a.v, b.v) }; }
+inline Vec fmadd(Vec a, Vec b, Vec c) { return Vec{ _mm512_fmadd_pd(a.v, b.v, c.v) }; }
+inline Vec sqrt(Vec a) { return Vec{ _mm512_sqrt_pd(a.v) }; }
+inline Vec min(Vec a, Vec b) { return Vec{ _mm512_min_pd(a.v, b.v) }; }
+inline Vec max(Vec a, Vec b) { return Vec{ _mm512_max_pd(a.v, b.v) }; }
+inline Vec floor(Vec a) { return Vec{ _mm512_roundscale_pd(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC) }; }
+inline Mask operator<(Vec a, Vec b) { return Mask{ _mm512_cmp_pd_mask(a.v, b.v, _CMP_LT_OQ) }; }
+inline Mask operator>(Vec a, Vec b) { return Mask{ _mm512_cmp_pd_mask(a.v, b.v, _CMP_GT_OQ) }; }
+inline Mask operator&(Mask a, Mask b) { return Mask{ (__mmask8)(a.m & b.m) }; }
+inline Mask andnot(Mask a, Mask b) { return Mask{ (__mmask8)(a.m & ~b.m) }; }
+inline bool any(Mask a) { return a.m != 0; }
+// Returns one bit per lane, lane 0 lowest
+inline int bits(Mask a) { return a.m; }
+inline Vec select(Mask m, Vec a, Vec b) { return Vec{ _mm512_mask_blend_pd(m.m, b.v, a.v) }; }
+// Loads base[index] for each lane. index must hold whole numbers
+inline Vec gather(const double* base, Vec index) {
+    return Vec{ _mm512_i32gather_pd(_mm512_cvttpd_epi32(index.v), base, 8) };
+}
+
+#elif defined(__AVX2__)
+
+const int k_Width = 4;
+inline const char* name() { return "AVX2"; }
+
+struct Vec { __m256d v; };
+struct Mask { __m256d m; };
+
+inline Vec set1(double x) { return Vec{ _mm256_set1_pd(x) }; }
+inline Vec load(const double* p) { return Vec{ _mm256_loadu_pd(p) }; }
+inline void store(double* p, Vec a) { _mm256_storeu_pd(p, a.v); }
+inline Vec operator+(Vec a, Vec b) { return Vec{ _mm256_add_pd(a.v, b.v) }; }
+inline Vec operator-(Vec a, Vec b) { return Vec{ _mm256_sub_pd(a.v, b.v) }; }
+inline Vec operator*(Vec a, Vec b) { return Vec{ _mm256_mul_pd(a.v, b.v) }; }
+inline Vec operator/(Vec a, Vec b) { return Vec{ _mm256_div_pd(a.v, b.v) }; }
+#if defined(__FMA__)
+inline Vec fmadd(Vec a, Vec b, Vec c) { return Vec{ _mm256_fmadd_pd(a.v, b.v, c.v) }; }
+#else
+inline Vec fmadd(Vec a, Vec b, Vec c) { return a * b + c; }
+#endif
+inline Vec sqrt(Vec a) { return Vec{ _mm256_sqrt_pd(a.v) }; }
+inline Vec min(Vec a, Vec b) { return Vec{ _mm256_min_pd(a.v, b.v) }; }
+inline Vec max(Vec a, Vec b) { return Vec{ _mm256_max_pd(a.v, b.v) }; }
+inline Vec floor(Vec a) { return Vec{ _mm256_floor_pd(a.v) }; }
+inline Mask operator<(Vec a, Vec b) { return Mask{ _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ) }; }
+inline Mask operator>(Vec a, Vec b) { return Mask{ _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ) }; }
+inline Mask operator&(Mask a, Mask b) { return Mask{ _mm256_and_pd(a.m, b.m) }; }
+inline Mask andnot(Mask a, Mask b) { return Mask{ _mm256_andnot_pd(b.m, a.m) }; }
+inline bool any(Mask a) { return _mm256_movemask_pd(a.m) != 0; }
+// Returns one bit per lane, lane 0 lowest
+inline int bits(Mask a) { return _mm256_movemask_pd(a.m); }
+inline Vec select(Mask m, Vec a, Vec b) { return Vec{ _mm256_blendv_pd(b.v, a.v, m.m) }; }
+// Loads base[index] for each lane. index must hold whole numbers
+inline Vec gather(const double* base, Vec index) {
+    return Vec{ _mm256_i32gather_pd(base, _mm256_cvttpd_epi32(index.v), 8) };
+}
+
+#else
+
+const int k_Width = 1;
+inline const char* name() { return "scalar"; }
+
+struct Vec { double v; };
+struct Mask { bool m; };
+
+inline Vec set1(double x) { return Vec{ x }; }
+inline Vec load(const double* p) { return Vec{ *p }; }
+inline void store(double* p, Vec a) { *p = a.v; }
+inline Vec operator+(Vec a, Vec b) { return Vec{ a.v + b.v }; }
+inline Vec operator-(Vec a, Vec b) { return Vec{ a.v - b.v }; }
+inline Vec operator*(Vec a, Vec b) { return Vec{ a.v * b.v }; }
+inline Vec operator/(Vec a, Vec b) { return Vec{ a.v / b.v }; }
+inline Vec fmadd(Vec a, Vec b, Vec c) { return Vec{ a.v * b.v + c.v }; }
+inline Vec sqrt(Vec a) { return Vec{ std::sqrt(a.v) }; }
+inline Vec min(Vec a, Vec b) { return Vec{ a.v < b.v ? a.v : b.v }; }
+inline Vec max(Vec a, Vec b) { return Vec{ a.v > b.v ? a.v : b.v }; }
+inline Vec floor(Vec a) { return Vec{ std::floor(a.v) }; }
+inline Mask operator<(Vec a, Vec b) { return Mask{ a.v < b.v }; }
+inline Mask operator>(Vec a, Vec b) { return Mask{ a.v > b.v }; }
+inline Mask operator&(Mask a, Mask b) { return Mask{ a.m && b.m }; }
+inline Mask andnot(Mask a, Mask b) { return Mask{ a.m && !b.m }; }
+inline bool any(Mask a) { return a.m; }
+// Returns one bit per lane, lane 0 lowest
+inline int bits(Mask a) { return a.m ? 1 : 0; }
+inline Vec select(Mask m, Vec a, Vec b) { return m.m ? a : b; }
+// Loads base[index] for each lane. index must hold whole numbers
+inline Vec gather(const double* base, Vec index) { return Vec{ base[(int)index.v] }; }
+
+#endif
+
+// Returns the number of lanes set in a
+inline int count(Mask a) { return (int)std::bitset<k_Width>((unsigned long long)bits(a)).count(); }
+
+} // namespace simd
+} // namespace trajectorysim
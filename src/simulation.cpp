@@ -1,36 +1,97 @@
 #include "stdafx.h"
 #include "Simulation.h"
+#include "DerivedState.h"
+#include "EventLocation.h"
+#include "KeplerOrbit.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <iomanip>
+#include <limits>
 #include <sstream>
 
 namespace trajectorysim {
 
-bool isFileExist(const char *filename) {
-    std::ifstream infile(filename);
-    return infile.good();
-}
+//Frames that runs integrate states in, giving altitude and converting states to ECEF, for recording gate crossings
+struct ECEFFrame {
+    double getAltitude(const Earth::Coords& pos) const { return Earth::ECEFToAlt(pos); }
+    State toECEF(const State& state) const { return state; }
+};
+
+struct FlatEarthFrame {
+    const LocalTangentPlane& plane;
+
+    double getAltitude(const Earth::Coords& pos) const { return pos.z; }
+    State toECEF(const State& state) const { return State{ plane.toECEF(state.pos), plane.toECEFVector(state.vel) }; }
+};
 
-Simulation::Simulation(Projectile* projectile, double dT, bool fulloutput, int run_num, std::string fileprefix)
+Simulation::Simulation(const Earth& earth, Projectile* projectile, double dT, bool fulloutput, int run_num, std::string fileprefix)
+    : earth(earth)
 {
     Simulation::projectile = projectile;
     Simulation::dT = dT;
     Simulation::run_num = run_num;
     Simulation::fulloutput = fulloutput;
     Simulation::fileprefix = fileprefix;
-    earth = Earth();
+    cancel = nullptr;
+    integrator = IntegratorSettings::defaults();
+    forces = ForceSettings::defaults();
+    steps = 0;
+    rejected_steps = 0;
+    evaluations = 0;
+    coast_alt = -1;
+    coast_enabled = false;
+    flat_earth = FlatEarthSettings{ false, 0, 0 };
+    anchor = Earth::LatLonAlt{ 0, 0, 0 };
+    limits = RunLimits::defaults();
+    status = k_Impact;
+}
 
+RunLimits RunLimits::defaults() {
+    return RunLimits{ 100000, 0, 100000 };
 }
 
-void Simulation::run() {
-    std::ostringstream solution_filename;
-    solution_filename << fileprefix << "solution.csv";
-    bool fileexists = isFileExist(solution_filename.str().c_str());
-    solutionfile.open(solution_filename.str(), std::ios_base::app);
-    if (!fileexists) {
-        solutionfile << "runNum, dT, tot time, pos_x, pos_y, pos_z, alt, mass, diameter, length, area, subsonic Cd, supersonic Cd, init vel_x, init vel_y, init vel_z" << std::endl;
-    }
+RunLimits RunLimits::scaledTo(double dT, double base_dT) const {
+    RunLimits scaled = *this;
+    double steps = std::ceil(max_steps * (base_dT / dT));
+    scaled.max_steps = steps < std::numeric_limits<int>::max() ? (int)steps : std::numeric_limits<int>::max();
+    return scaled;
+}
+
+void Simulation::setIntegrator(IntegratorSettings integrator) {
+    Simulation::integrator = integrator;
+}
+
+void Simulation::setCancelFlag(const std::atomic<bool>* cancel) {
+    Simulation::cancel = cancel;
+}
+
+void Simulation::setForces(ForceSettings forces) {
+    Simulation::forces = forces;
+}
+
+void Simulation::setRunLimits(RunLimits limits) {
+    Simulation::limits = limits;
+}
+
+void Simulation::setCoastAltitude(double coast_alt) {
+    Simulation::coast_alt = coast_alt;
+}
+
+void Simulation::setFlatEarth(FlatEarthSettings flat_earth, Earth::LatLonAlt anchor) {
+    Simulation::flat_earth = flat_earth;
+    Simulation::anchor = anchor;
+}
+
+bool GateSettings::empty() const {
+    return altitudes.empty() && times.empty();
+}
+
+void Simulation::setGates(GateSettings gates) {
+    Simulation::gates = gates;
+}
 
+void Simulation::run() {
     if (fulloutput) {
         std::ostringstream filename;
         filename << fileprefix << "run_" << run_num << ".csv";
@@ -44,35 +105,344 @@ void Simulation::run() {
 
     stepoutput();
 
-    int count = 0;
+    steps = 0;
+    rejected_steps = 0;
+    evaluations = 0;
+    coast_enabled = coast_alt >= 0;
+    status = k_Impact;
+    crossings.clear();
+    start_time = std::chrono::steady_clock::now();
+    switch (integrator.type) {
+    case IntegratorSettings::k_SemiImplicitEuler: runFixedStep<SemiImplicitEulerStep>(); break;
+    case IntegratorSettings::k_VelocityVerlet: runFixedStep<VelocityVerletStep>(); break;
+    case IntegratorSettings::k_Heun: runFixedStep<HeunStep>(); break;
+    case IntegratorSettings::k_RK4: runFixedStep<RK4Step>(); break;
+    case IntegratorSettings::k_RK45: runDormandPrince(); break;
+    default: runConstantAccel(); break;
+    }
 
-    while ((projectile->getAltitude() > 0) && (count < 100000)) {
-        time += dT;
+    runfile.close();
+
+}
+
+bool Simulation::isStopped(bool check_leaving) {
+    if (projectile->getAltitude() <= 0) {
+        status = k_Impact;
+        return true;
+    }
+    int total_steps = steps + rejected_steps;
+    if (total_steps >= limits.max_steps) {
+        status = k_StepLimit;
+        return true;
+    }
+    if (cancel && cancel->load(std::memory_order_relaxed)) return true;
+    //Reading the clock costs more than a step's checks, so only do it every 256 steps
+    if ((limits.max_wall_time > 0) && ((total_steps & 255) == 0) &&
+        (std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count() > limits.max_wall_time)) {
+        status = k_TimeLimit;
+        return true;
+    }
+    return check_leaving && isLeaving();
+}
+
+bool Simulation::isLeaving() {
+    RunStatus leaving = classifyLeaving(projectile->GetPos(), projectile->GetVel(), projectile->getAltitude(), limits, earth.atmosphere.getTopAltitude());
+    if (leaving == k_Impact) return false;
+    status = leaving;
+    return true;
+}
+
+RunStatus Simulation::classifyLeaving(const Earth::Coords& pos, const Earth::Coords& vel, double altitude, const RunLimits& limits, double atmosphere_top) {
+    //The perigee is never above the projectile, so nothing within the atmosphere is leaving
+    if (altitude <= atmosphere_top) return k_Impact;
+    double rv = pos.x * vel.x + pos.y * vel.y + pos.z * vel.z;
+    if (rv <= 0) return k_Impact;
+
+    //Specific orbital energy, with the model's gravity here
+    double mu = getGravitationalParameter(pos, altitude);
+    double r2 = pos.x * pos.x + pos.y * pos.y + pos.z * pos.z;
+    double v2 = vel.x * vel.x + vel.y * vel.y + vel.z * vel.z;
+    double r = sqrt(r2);
+    double energy = v2 / 2 - mu / r;
+    if (energy >= 0) return k_Escape;
+    //Perigee from the semi-major axis and eccentricity, as an altitude above the ellipsoid below the projectile
+    double semi_major = -mu / (2 * energy);
+    double ecc = sqrt(std::max(0.0, 1 - (r2 * v2 - rv * rv) / (mu * semi_major)));
+    double perigee_alt = semi_major * (1 - ecc) - (r - altitude);
+    if ((perigee_alt > limits.orbital_perigee_alt) && (perigee_alt > atmosphere_top)) return k_Orbital;
+    return k_Impact;
+}
+
+bool Simulation::coast() {
+    if (!coast_enabled || (projectile->getAltitude() <= coast_alt)) return false;
+    State start{ projectile->GetPos(), projectile->GetVel() };
+    //The model's gravity falls off with altitude above the ellipsoid rather than with radius, so its equivalent
+    //gravitational parameter varies along the orbit. Use its average over the coast, by Simpson's rule
+    double start_alt = projectile->getAltitude();
+    double start_mu = getGravitationalParameter(start.pos, start_alt);
+    double mu = start_mu;
+    double orbit_mu;
+    State entry;
+    double t;
+    double begin, begin_alt;
+    for (int pass = 0; pass < 2; ++pass) {
+        orbit_mu = mu;
+        KeplerOrbit orbit(start, mu);
+        double end;
+        if (!orbit.getDescent(begin, end)) {
+            coast_enabled = false;
+            return false;
+        }
+        double end_alt = Earth::ECEFToAlt(orbit.at(end).pos);
+        if (end_alt > coast_alt) {
+            coast_enabled = false;
+            return false;
+        }
+        begin_alt = begin > 0 ? Earth::ECEFToAlt(orbit.at(begin).pos) : start_alt;
+        t = locateAltitude(orbit, begin, end, begin_alt, end_alt, coast_alt);
+        entry = orbit.at(t);
+        Earth::Coords middle = orbit.at(t / 2).pos;
+        mu = (start_mu + 4 * getGravitationalParameter(middle, Earth::ECEFToAlt(middle)) +
+            getGravitationalParameter(entry.pos, Earth::ECEFToAlt(entry.pos))) / 6;
+    }
+    if (!gates.empty()) {
+        //Altitude isn't monotonic over the coast if it starts ascending, so record each side of apoapsis separately
+        KeplerOrbit orbit(start, orbit_mu);
+        double entry_alt = Earth::ECEFToAlt(entry.pos);
+        if (begin > 0) recordGates(orbit, ECEFFrame(), time, 0, begin, start_alt, begin_alt);
+        recordGates(orbit, ECEFFrame(), time, begin, t, begin_alt, entry_alt);
+    }
+    projectile->setState(entry.pos, entry.vel);
+    time += t;
+    stepoutput();
+    ++steps;
+    return true;
+}
+
+double Simulation::getGravitationalParameter(const Earth::Coords& pos, double altitude) {
+    return -Earth::getGravity(altitude) * (pos.x * pos.x + pos.y * pos.y + pos.z * pos.z);
+}
 
-        Earth::Properties airProp = earth.setProperties(projectile->getAltitude());
+Earth::Coords Simulation::getAccel() {
+    ++evaluations;
+    DerivedState state = DerivedState::compute(earth, projectile->GetPos(), projectile->GetVel(), projectile->getAltitude());
+    //The default set inlined, rather than called through the kernel pointer
+    if (forces.isDefault()) return DefaultForces::accel(state, *projectile);
+    return forces.kernel(state, *projectile);
+}
+
+Earth::Coords Simulation::getFlatEarthAccel(const Earth::Coords& pos, const Earth::Coords& vel, const Earth::Coords& gravity_dir) {
+    ++evaluations;
+    //Altitude is up in the plane. The radial direction is meaningless there, so gravity uses gravity_dir instead
+    DerivedState state = DerivedState::compute(earth, pos, vel, pos.z);
+    Earth::Coords a_drag = projectile->GetDragAccel(state);
+    double g = -Earth::getGravity(pos.z);
+    return Earth::Coords{ a_drag.x + g * gravity_dir.x, a_drag.y + g * gravity_dir.y, a_drag.z + g * gravity_dir.z };
+}
 
-        bool subsonic = (airProp.speed_of_sound > projectile->GetVelMag());
-        Earth::Coords a_drag = projectile->GetDragAccel(airProp.density, subsonic, projectile->getFrontalArea());
-        Earth::Coords a_grav = Earth::Gravity_Accel(projectile->GetPos());
-        //sum accels
-        Earth::Coords a_tot = {
-            a_drag.x + a_grav.x,
-            a_drag.y + a_grav.y,
-            a_drag.z + a_grav.z
-        };
+template <typename Scheme>
+bool Simulation::runFlatEarth() {
+    LocalTangentPlane plane(anchor);
+    State state{ plane.fromECEF(projectile->GetPos()), plane.fromECEFVector(projectile->GetVel()) };
+    //As the model's gravity, towards the centre of the earth, rather than straight down
+    Earth::Coords gravity_dir = plane.getGravityDirection();
+    auto accel = [this, &gravity_dir](const Earth::Coords& pos, const Earth::Coords& vel) {
+        return getFlatEarthAccel(pos, vel, gravity_dir);
+    };
 
-        projectile->updatePosition(a_tot, dT);
+    //The projectile's ECEF state isn't kept up to date in the plane, so leaving runs are only classified once they've
+    //left its limits and continue in ECEF
+    while ((state.pos.z > 0) && !isStopped(false)) {
+        if ((state.pos.z > flat_earth.max_alt) || (LocalTangentPlane::getRange(state.pos) > flat_earth.max_range)) {
+            //Beyond the limits, so continue in ECEF from here. Runs starting beyond them are left untouched
+            if (steps > 0) projectile->setState(plane.toECEF(state.pos), plane.toECEFVector(state.vel));
+            return false;
+        }
+        State start = state;
+        Earth::Coords start_accel = accel(start.pos, start.vel);
+        state = Scheme::step(start, start_accel, dT, accel);
+        time += dT;
+        if ((state.pos.z <= 0) || isGateCrossed(time - dT, time, start.pos.z, state.pos.z)) {
+            auto path = Scheme::path(start, start_accel, state, dT, accel);
+            double elapsed = dT;
+            if (state.pos.z <= 0) {
+                //Impact, somewhere within this step. Move back to where the step's path crosses the ground
+                auto altitude = [&path](double t) { return path.at(t).pos.z; };
+                elapsed = locateCrossing(altitude, 0.0, dT, start.pos.z, state.pos.z);
+                state = path.at(elapsed);
+                time += elapsed - dT;
+            }
+            if (!gates.empty()) recordGates(path, FlatEarthFrame{ plane }, time - elapsed, 0, elapsed, start.pos.z, state.pos.z);
+        }
+        ++steps;
+        if (fulloutput && (state.pos.z > 0)) {
+            projectile->setState(plane.toECEF(state.pos), plane.toECEFVector(state.vel));
+            stepoutput();
+        }
+    }
+    //Runs starting on or below ground are left as they started, as in ECEF
+    if (steps == 0) return true;
+    if (state.pos.z <= 0) {
+        //Report the impact on the ellipsoid, which falls away from the plane
+        projectile->setState(plane.toGround(state.pos), plane.toECEFVector(state.vel));
+        stepoutput();
+    }
+    else {
+        projectile->setState(plane.toECEF(state.pos), plane.toECEFVector(state.vel));
+    }
+    return true;
+}
 
+void Simulation::runConstantAccel() {
+    if (flat_earth.enabled && runFlatEarth<ConstantAccelStep>()) return;
+    while (!isStopped()) {
+        if (coast()) continue;
+        State start{ projectile->GetPos(), projectile->GetVel() };
+        double start_alt = projectile->getAltitude();
+        Earth::Coords accel = getAccel();
+        time += dT;
+        projectile->updatePosition(accel, dT);
+        double end_alt = projectile->getAltitude();
+        if ((end_alt <= 0) || isGateCrossed(time - dT, time, start_alt, end_alt)) {
+            ConstantAccelPath path(start, accel);
+            double elapsed = dT;
+            if (end_alt <= 0) {
+                //Impact, somewhere within this step. Move back to where the path crosses the ground
+                elapsed = locateImpact(path, dT, start_alt, end_alt);
+                State impact = path.at(elapsed);
+                projectile->setState(impact.pos, impact.vel);
+                time += elapsed - dT;
+                end_alt = projectile->getAltitude();
+            }
+            if (!gates.empty()) recordGates(path, ECEFFrame(), time - elapsed, 0, elapsed, start_alt, end_alt);
+        }
         stepoutput();
-        ++count;
+        ++steps;
     }
+}
 
-    solutionoutput();
-    std::cout << "Run " << run_num << ": Simulation ended at " << time << " secs" << std::endl;
+template <typename Scheme>
+void Simulation::runFixedStep() {
+    if (flat_earth.enabled && runFlatEarth<Scheme>()) return;
+    auto accel = [this](const Earth::Coords& pos, const Earth::Coords& vel) {
+        projectile->setState(pos, vel);
+        return getAccel();
+    };
 
-    runfile.close();
-    solutionfile.close();
+    while (!isStopped()) {
+        if (coast()) continue;
+        State start{ projectile->GetPos(), projectile->GetVel() };
+        double start_alt = projectile->getAltitude();
+        Earth::Coords start_accel = getAccel();
+        State end = Scheme::step(start, start_accel, dT, accel);
+        projectile->setState(end.pos, end.vel);
+        time += dT;
+        double end_alt = projectile->getAltitude();
+        if ((end_alt <= 0) || isGateCrossed(time - dT, time, start_alt, end_alt)) {
+            //Evaluating the acceleration at the end of the step leaves the projectile there
+            auto path = Scheme::path(start, start_accel, end, dT, accel);
+            double elapsed = dT;
+            if (end_alt <= 0) {
+                //Impact, somewhere within this step. Move back to where the step's path crosses the ground
+                elapsed = locateImpact(path, dT, start_alt, end_alt);
+                State impact = path.at(elapsed);
+                projectile->setState(impact.pos, impact.vel);
+                time += elapsed - dT;
+                end_alt = projectile->getAltitude();
+            }
+            if (!gates.empty()) recordGates(path, ECEFFrame(), time - elapsed, 0, elapsed, start_alt, end_alt);
+        }
+        stepoutput();
+        ++steps;
+    }
+}
+
+void Simulation::runDormandPrince() {
+    auto accel = [this](const Earth::Coords& pos, const Earth::Coords& vel) {
+        projectile->setState(pos, vel);
+        return getAccel();
+    };
+    DormandPrince stepper(integrator.abstol, integrator.reltol, integrator.min_step);
+    State state{ projectile->GetPos(), projectile->GetVel() };
+    stepper.start(state, accel);
+    double h = dT;
+
+    while (!isStopped()) {
+        if (coast()) {
+            //Restart from the end of the coast, as the derivative kept from the last step is stale
+            state = State{ projectile->GetPos(), projectile->GetVel() };
+            stepper.start(state, accel);
+            continue;
+        }
+        double step = h;
+        double start_alt = projectile->getAltitude();
+        bool accepted = stepper.step(state, h, accel);
+        //Leave the projectile at the current state, rather than the last stage evaluated
+        projectile->setState(state.pos, state.vel);
+        if (accepted) {
+            time += step;
+            double end_alt = projectile->getAltitude();
+            if ((end_alt <= 0) || isGateCrossed(time - step, time, start_alt, end_alt)) {
+                HermitePath path(stepper.getPrevious(), stepper.getPreviousDerivative(), state, stepper.getDerivative(), step);
+                double elapsed = step;
+                if (end_alt <= 0) {
+                    //Impact, somewhere within this step. Move back to where the step's dense output crosses the ground
+                    elapsed = locateImpact(path, step, start_alt, end_alt);
+                    State impact = path.at(elapsed);
+                    projectile->setState(impact.pos, impact.vel);
+                    time += elapsed - step;
+                    end_alt = projectile->getAltitude();
+                }
+                if (!gates.empty()) recordGates(path, ECEFFrame(), time - elapsed, 0, elapsed, start_alt, end_alt);
+            }
+            stepoutput();
+            ++steps;
+        }
+        else {
+            ++rejected_steps;
+        }
+    }
+}
+
+bool Simulation::isGateCrossed(double begin, double end, double start_alt, double end_alt) const {
+    for (double gate : gates.altitudes) {
+        if ((start_alt > gate) != (end_alt > gate)) return true;
+    }
+    for (double gate : gates.times) {
+        if ((gate > begin) && (gate <= end)) return true;
+    }
+    return false;
+}
+
+template <typename Path, typename Frame>
+void Simulation::recordGates(const Path& path, const Frame& frame, double start_time, double begin, double end, double begin_alt, double end_alt) {
+    size_t first = crossings.size();
+    for (double gate : gates.altitudes) {
+        //Distance to the gate, positive on the side the step starts on, as locateCrossing() requires
+        double sign;
+        if ((begin_alt > gate) && (end_alt <= gate)) sign = 1;
+        else if ((begin_alt <= gate) && (end_alt > gate)) sign = -1;
+        else continue;
+        auto distance = [&path, &frame, gate, sign](double t) { return sign * (frame.getAltitude(path.at(t).pos) - gate); };
+        double t = begin_alt == gate ? begin : locateCrossing(distance, begin, end, sign * (begin_alt - gate), sign * (end_alt - gate));
+        State state = path.at(t);
+        addCrossing(k_AltitudeGate, gate, start_time + t, frame.toECEF(state), frame.getAltitude(state.pos));
+    }
+    for (double gate : gates.times) {
+        double t = gate - start_time;
+        if ((t <= begin) || (t > end)) continue;
+        State state = path.at(t);
+        addCrossing(k_TimeGate, gate, gate, frame.toECEF(state), frame.getAltitude(state.pos));
+    }
+    //A step may cross several gates
+    std::sort(crossings.begin() + first, crossings.end(), [](const GateCrossing& lhs, const GateCrossing& rhs) {
+        return lhs.time < rhs.time;
+    });
+}
 
+void Simulation::addCrossing(GateType type, double gate, double time, const State& state, double alt) {
+    DerivedState derived = DerivedState::compute(earth, state.pos, state.vel, alt);
+    crossings.push_back(GateCrossing{ type, gate, time, state.pos, state.vel, alt, derived.mach, derived.dynamic_pressure });
 }
 
 void Simulation::stepoutput() {
@@ -86,16 +456,94 @@ void Simulation::stepoutput() {
     runfile << std::endl;
 }
 
-void Simulation::solutionoutput() {
-    Earth::Coords Pos_ECEF = projectile->GetPos();
+int Simulation::getEvaluationCount() {
+    return evaluations;
+}
+
+SolutionRecord Simulation::getSolution() {
+    return SolutionRecord{
+        run_num,
+        dT,
+        time,
+        projectile->GetPos(),
+        projectile->getAltitude(),
+        projectile->getProperties(),
+        projectile->getDragCoeff(true),
+        projectile->getDragCoeff(false),
+        initvel,
+        steps,
+        rejected_steps,
+        -1,
+        -1,
+        Earth::Coords{ 0, 0, 0 },
+        0,
+        -1,
+        status,
+        crossings
+    };
+}
+
+//Names of run statuses in [prefix]solution.csv, in RunStatus order
+static const char* k_StatusNames[] = { "impact", "escape", "orbital", "step limit", "time limit" };
+
+const char* Simulation::getStatusName(RunStatus status) {
+    return k_StatusNames[status];
+}
+
+void Simulation::writeSolutionHeader(std::ostream& out) {
+    out << "runNum, dT, tot time, pos_x, pos_y, pos_z, alt, mass, diameter, length, area, subsonic Cd, supersonic Cd, init vel_x, init vel_y, init vel_z, steps, rejected steps, dT error est, dT time error est, extrap pos_x, extrap pos_y, extrap pos_z, extrap tot time, extrap error est, status" << std::endl;
+}
+
+void Simulation::writeSolution(std::ostream& out, const SolutionRecord& solution) {
+    out << std::setprecision(9);
+    out << solution.run_num << "," << solution.dT << "," << solution.time << ",";
+    out << solution.pos.x << "," << solution.pos.y << "," << solution.pos.z << ",";
+    out << solution.alt << ",";
+    out << solution.properties << ",";
+    out << solution.Cd_subsonic << "," << solution.Cd_supersonic << ",";
+    out << solution.initvel.x << "," << solution.initvel.y << "," << solution.initvel.z << ",";
+    out << solution.steps << "," << solution.rejected_steps << ",";
+    if (solution.dT_error >= 0) out << solution.dT_error << "," << solution.dT_time_error << ",";
+    else out << ",,";
+    if (solution.extrapolation_error >= 0) {
+        out << solution.extrapolated_pos.x << "," << solution.extrapolated_pos.y << "," << solution.extrapolated_pos.z << ",";
+        out << solution.extrapolated_time << "," << solution.extrapolation_error << ",";
+    }
+    else {
+        out << ",,,,,";
+    }
+    out << k_StatusNames[solution.status] << ",";
+    out << "\n";
+}
+
+//Names of gate types in [prefix]gates.csv, in GateType order
+static const char* k_GateNames[] = { "alt", "time" };
+
+void Simulation::writeGatesHeader(std::ostream& out) {
+    out << "runNum, gate, gate value, time, pos_x, pos_y, pos_z, vel_x, vel_y, vel_z, alt, mach, dynamic pressure" << std::endl;
+}
+
+void Simulation::writeGates(std::ostream& out, const SolutionRecord& solution) {
+    out << std::setprecision(9);
+    for (const GateCrossing& crossing : solution.gates) {
+        out << solution.run_num << "," << k_GateNames[crossing.type] << "," << crossing.gate << "," << crossing.time << ",";
+        out << crossing.pos.x << "," << crossing.pos.y << "," << crossing.pos.z << ",";
+        out << crossing.vel.x << "," << crossing.vel.y << "," << crossing.vel.z << ",";
+        out << crossing.alt << "," << crossing.mach << "," << crossing.dynamic_pressure << "\n";
+    }
+}
 
-    solutionfile << std::setprecision(9);
-    solutionfile << run_num << "," << dT << "," << time << ",";
-    solutionfile << Pos_ECEF.x << "," << Pos_ECEF.y << "," << Pos_ECEF.z << ",";
-    solutionfile << projectile->getAltitude() << ",";
-    solutionfile << projectile->getProperties() << ",";
-    solutionfile << projectile->getDragCoeff(true) << "," << projectile->getDragCoeff(false) << ",";
-    solutionfile << initvel.x << "," << initvel.y << "," << initvel.z << ",";
-    solutionfile << std::endl;
+void Simulation::extrapolate(SolutionRecord& solution, const SolutionRecord& coarse, int order) {
+    if ((solution.status != k_Impact) || (coarse.status != k_Impact)) return;
+    //Error at dT is (fine - coarse) / (2^order - 1), to leading order
+    double scale = 1 / (pow(2, order) - 1);
+    Earth::Coords correction{
+        (solution.pos.x - coarse.pos.x) * scale,
+        (solution.pos.y - coarse.pos.y) * scale,
+        (solution.pos.z - coarse.pos.z) * scale
+    };
+    solution.extrapolated_pos = Earth::Coords{ solution.pos.x + correction.x, solution.pos.y + correction.y, solution.pos.z + correction.z };
+    solution.extrapolated_time = solution.time + (solution.time - coarse.time) * scale;
+    solution.extrapolation_error = sqrt(pow(correction.x, 2) + pow(correction.y, 2) + pow(correction.z, 2));
 }
 } // namespace trajectorysim
\ No newline at end of file
@@ -1,40 +1,254 @@
 #pragma once
+#include "Forces.h"
+#include "Integrators.h"
+#include "LocalTangentPlane.h"
 #include "Projectile.h"
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
 
 namespace trajectorysim {
+
+// How a run ended, as written to [prefix]solution.csv
+enum RunStatus {
+    // Reached the ground
+    k_Impact,
+    // Ascending with escape energy, so never coming down
+    k_Escape,
+    // Ascending in an orbit whose perigee is above RunLimits::orbital_perigee_alt and the atmosphere, so not reentering
+    k_Orbital,
+    // Stopped by RunLimits::max_steps, or max_wall_time
+    k_StepLimit,
+    k_TimeLimit
+};
+
+// Limits stopping runs that won't reach the ground, or are taking too long to
+struct RunLimits {
+    // Integrator steps per run, accepted and rejected
+    int max_steps;
+    // Wall time per run, in secs. 0 for no limit
+    double max_wall_time;
+    // Perigee altitude, in m, above which ascending runs are stopped as orbital. Perigees within the atmosphere table
+    // never are, whatever this is set to
+    double orbital_perigee_alt;
+
+    // Returns the limits used unless set: 100000 steps, no time limit, and a perigee above 100 km
+    static RunLimits defaults();
+
+    // Returns these limits for runs at dT, with max_steps scaled by base_dT / dT, so a run at a finer dT than the
+    // limits were set for can still cover the same simulated time
+    RunLimits scaledTo(double dT, double base_dT) const;
+};
+
+// Altitudes, in m, and times after launch, in secs, at which each run's state is recorded as it crosses them
+struct GateSettings {
+    std::vector<double> altitudes;
+    std::vector<double> times;
+
+    bool empty() const;
+};
+
+enum GateType {
+    k_AltitudeGate,
+    k_TimeGate
+};
+
+// State of a run as it crossed a gate, interpolated along the step that crossed it, as written to a line of
+// [prefix]gates.csv. Altitude gates are recorded each time they're crossed, ascending or descending
+struct GateCrossing {
+    GateType type;
+    // Gate altitude, or time
+    double gate;
+    double time;
+    Earth::Coords pos;
+    Earth::Coords vel;
+    double alt;
+    double mach;
+    // 1/2 rho v^2, in Pa
+    double dynamic_pressure;
+};
+
+// Final state of a single run, as written to a line of [prefix]solution.csv
+struct SolutionRecord {
+    int run_num;
+    double dT;
+    double time;
+    Earth::Coords pos;
+    double alt;
+    std::string properties;
+    double Cd_subsonic;
+    double Cd_supersonic;
+    Earth::Coords initvel;
+    // Accepted and rejected integrator steps
+    int steps;
+    int rejected_steps;
+    // Discretization error estimated for dT by TimestepCalibration, in impact position, m, and time, secs.
+    // Negative if dT wasn't calibrated
+    double dT_error;
+    double dT_time_error;
+    // Impact point and time Richardson extrapolated from a paired run at twice dT, and the estimated error of the
+    // run's own impact point, in m, that the extrapolation corrects. The error is negative if not extrapolated
+    Earth::Coords extrapolated_pos;
+    double extrapolated_time;
+    double extrapolation_error;
+    // The position and time are only an impact if status is k_Impact
+    RunStatus status;
+    // Gates crossed, in time order
+    std::vector<GateCrossing> gates;
+};
+
 class Simulation
 {
 public:
-    // Create a Simulation object. Required before running sim, using run(). Will output results to [prefix]solution.csv, and if
-    // fullout is true, [prefix]run_[run_num].csv as well.
+    // Create a Simulation object. Required before running sim, using run(). The run's solution is available from
+    // getSolution() once run() completes, and if fullout is true, per-step results are written to [prefix]run_[run_num].csv.
+    // earth provides the atmosphere model, and is only read from, so may be shared between simulations on different threads
     // Projectile must be a pointer, and can include child classes
     // dT is the simulation time step in secs
     // fulloutput if set to true will generate separate .csv files for each simulation run with full pos/vel outputs
     // run_num is used to identify the run in output files
     // fileprefix adds a prefix to output files if further separation of simulation outputs is required
-    Simulation(Projectile* projectile, double dT, bool fulloutput = false, int run_num = 1, std::string fileprefix = "");
+    Simulation(const Earth& earth, Projectile* projectile, double dT, bool fulloutput = false, int run_num = 1, std::string fileprefix = "");
 
     // Runs the simulation
     void run();
 
+    // Selects the integrator used by run(). Defaults to the fixed-step constant-acceleration update
+    void setIntegrator(IntegratorSettings integrator);
+
+    // Sets a flag checked between steps of run(), which stops the run early when set, from any thread.
+    // Stopped runs are incomplete, so their solution should not be used
+    void setCancelFlag(const std::atomic<bool>* cancel);
+
+    // Sets the limits stopping runs early. Defaults to RunLimits::defaults()
+    void setRunLimits(RunLimits limits);
+
+    // Selects the force models summed for the acceleration. Defaults to ForceSettings::defaults(), gravity and drag.
+    // Flat earth runs always use gravity and drag
+    void setForces(ForceSettings forces);
+
+    // Above coast_alt, in m, drag is neglected, as is J2, and the projectile moves in a single step along its Keplerian orbit
+    // to where it descends back to coast_alt, or to impact if coast_alt is 0. Negative, the default, never coasts
+    void setCoastAltitude(double coast_alt);
+
+    // If enabled, fixed-step runs start in the plane tangent to the ellipsoid below anchor, the run's initial position,
+    // with altitude as a coordinate and gravity in a fixed direction, avoiding the cost of finding altitude in ECEF. Runs
+    // continue in ECEF once beyond the flat earth limits. Impacts are still reported in ECEF, on the ellipsoid
+    void setFlatEarth(FlatEarthSettings flat_earth, Earth::LatLonAlt anchor);
+
+    // Records the run's state at each crossing of gates, without the cost of full per-step output. Defaults to none
+    void setGates(GateSettings gates);
+
     // Function to output sim results to [prefix]run_[run_num].csv on each timestep
     void stepoutput();
 
-    // Function to output sim results to [prefix]solution.csv after run completion
-    void solutionoutput();
+    // Returns sim results after run completion
+    SolutionRecord getSolution();
+
+    // Returns the number of evaluations of the acceleration made by the last run, a measure of its cost
+    int getEvaluationCount();
+
+    // Returns status's name, as written to [prefix]solution.csv
+    static const char* getStatusName(RunStatus status);
+
+    // Returns k_Escape or k_Orbital if a projectile at pos and vel, at altitude, is ascending and won't come back
+    // down. Drag must be negligible for the rest of the run for that to hold, so it only escapes if already above the
+    // top of the atmosphere table, atmosphere_top, and only orbits if its perigee is above both atmosphere_top and
+    // limits.orbital_perigee_alt. Otherwise returns k_Impact, leaving the run to reach the ground.
+    // Shared by Simulation and BatchSimulation, so a run ends the same way batched or not
+    static RunStatus classifyLeaving(const Earth::Coords& pos, const Earth::Coords& vel, double altitude, const RunLimits& limits, double atmosphere_top);
+
+    // Writes the column headings for [prefix]solution.csv
+    static void writeSolutionHeader(std::ostream& out);
+
+    // Writes a single run's results as a line of [prefix]solution.csv
+    static void writeSolution(std::ostream& out, const SolutionRecord& solution);
+
+    // Writes the column headings for [prefix]gates.csv
+    static void writeGatesHeader(std::ostream& out);
+
+    // Writes a single run's gate crossings as lines of [prefix]gates.csv
+    static void writeGates(std::ostream& out, const SolutionRecord& solution);
+
+    // Richardson extrapolates solution's impact point and time, combining them with coarse's, from the same case run
+    // at twice the dT, assuming the error converges at order. Left unextrapolated if either run didn't impact
+    static void extrapolate(SolutionRecord& solution, const SolutionRecord& coarse, int order);
 
 private:
+    // Returns the acceleration due to the selected force models on the projectile in its current state
+    Earth::Coords getAccel();
+
+    // Integrates with the constant-acceleration update and a fixed step of dT
+    void runConstantAccel();
+
+    // Integrates with a fixed step of dT, using one of the fixed-step integrators in Integrators.h
+    template <typename Scheme>
+    void runFixedStep();
+
+    // Integrates in the local tangent plane, while within the flat earth limits. Returns true if the run ended, and
+    // false if it left the limits, with the projectile moved to where it did
+    template <typename Scheme>
+    bool runFlatEarth();
+
+    // Returns the acceleration due to drag and gravity at pos and vel in the local tangent plane, with gravity acting
+    // along gravity_dir
+    Earth::Coords getFlatEarthAccel(const Earth::Coords& pos, const Earth::Coords& vel, const Earth::Coords& gravity_dir);
+
+    // Integrates with the adaptive Dormand-Prince pair, starting with a step of dT
+    void runDormandPrince();
+
+    // Returns true if the run should stop before its next step, setting its status. Checks isLeaving() only if
+    // check_leaving, as it reads the projectile's ECEF state
+    bool isStopped(bool check_leaving = true);
+
+    // Returns true, setting the run's status, if classifyLeaving() finds the projectile won't come back down
+    bool isLeaving();
+
+    // Coasts if above coast_alt, returning true if the projectile was moved
+    bool coast();
+
+    // Returns true if a step from time begin to end secs, and start_alt to end_alt, crossed any gate
+    bool isGateCrossed(double begin, double end, double start_alt, double end_alt) const;
+
+    // Records the gates crossed between begin and end secs along path, which gives states in frame, starting start_time
+    // secs into the run. begin_alt and end_alt are the altitudes there
+    template <typename Path, typename Frame>
+    void recordGates(const Path& path, const Frame& frame, double start_time, double begin, double end, double begin_alt, double end_alt);
+
+    // Records a gate crossing at time, in ECEF state at alt
+    void addCrossing(GateType type, double gate, double time, const State& state, double alt);
+
+    // Returns the gravitational parameter, in m^3/s^2, giving the model's gravity at pos, at altitude
+    static double getGravitationalParameter(const Earth::Coords& pos, double altitude);
+
     Projectile* projectile;
     double time;
     double dT;
     int run_num;
     bool fulloutput;
     std::string fileprefix;
-    std::ofstream solutionfile;
     std::ofstream runfile;
-    Earth earth;
+    const Earth& earth;
     Earth::Coords initpos;
     Earth::Coords initvel;
+    const std::atomic<bool>* cancel;
+    IntegratorSettings integrator;
+    ForceSettings forces;
+    int steps;
+    int rejected_steps;
+    int evaluations;
+    double coast_alt;
+    // Cleared once an orbit is found not to descend to coast_alt, as later orbits, without drag, won't either
+    bool coast_enabled;
+    FlatEarthSettings flat_earth;
+    Earth::LatLonAlt anchor;
+    RunLimits limits;
+    RunStatus status;
+    GateSettings gates;
+    std::vector<GateCrossing> crossings;
+    std::chrono::steady_clock::time_point start_time;
 };
-} // namespace trajectorysim
\ No newline at end of file
+} // namespace trajectorysim
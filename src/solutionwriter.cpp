@@ -0,0 +1,148 @@
+#include "stdafx.h"
+#include "SolutionWriter.h"
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+namespace trajectorysim {
+
+// Largest number of records formatted into one write
+static const int k_WriteBatch = 256;
+
+static bool isFileExist(const char *filename) {
+    std::ifstream infile(filename);
+    return infile.good();
+}
+
+SolutionWriter::SolutionWriter(std::string fileprefix, int firstRun, int endRun, bool writeGates, size_t queueCapacity)
+    : queue(queueCapacity), next_run(firstRun), statistics(firstRun, endRun), written(0), finishing(false)
+{
+    SolutionWriter::fileprefix = fileprefix;
+    write_gates = writeGates;
+    cancel = nullptr;
+}
+
+SolutionWriter::~SolutionWriter() {
+    finish();
+}
+
+void SolutionWriter::start() {
+    std::ostringstream solution_filename;
+    solution_filename << fileprefix << "solution.csv";
+    bool fileexists = isFileExist(solution_filename.str().c_str());
+    solutionfile.open(solution_filename.str(), std::ios_base::app);
+    if (!fileexists) {
+        Simulation::writeSolutionHeader(solutionfile);
+    }
+    if (write_gates) {
+        std::string gates_filename = fileprefix + "gates.csv";
+        fileexists = isFileExist(gates_filename.c_str());
+        gatesfile.open(gates_filename, std::ios_base::app);
+        if (!fileexists) {
+            Simulation::writeGatesHeader(gatesfile);
+        }
+    }
+    finishing = false;
+    writer = std::thread(&SolutionWriter::writerLoop, this);
+}
+
+void SolutionWriter::push(SolutionRecord record) {
+    int idle = 0;
+    while (!accepts(record.run_num)) {
+        if (cancel && cancel->load(std::memory_order_relaxed)) return;
+        if (++idle < 64) {
+            std::this_thread::yield();
+        }
+        else {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    queue.push(std::move(record));
+}
+
+bool SolutionWriter::accepts(int run_num) {
+    return run_num - next_run < k_ReorderWindow;
+}
+
+void SolutionWriter::setCancelFlag(const std::atomic<bool>* cancel) {
+    SolutionWriter::cancel = cancel;
+}
+
+void SolutionWriter::finish() {
+    if (!writer.joinable()) return;
+    finishing = true;
+    writer.join();
+    solutionfile.close();
+    gatesfile.close();
+}
+
+int SolutionWriter::getWrittenCount() { return written; }
+
+StatisticsNode SolutionWriter::getStatistics() {
+    std::lock_guard<std::mutex> lock(statistics_mutex);
+    return statistics.finalize();
+}
+
+std::vector<StatisticsBlock> SolutionWriter::getStatisticsBlocks() {
+    std::lock_guard<std::mutex> lock(statistics_mutex);
+    return statistics.getBlocks();
+}
+
+void SolutionWriter::writerLoop() {
+    int idle = 0;
+    for (;;) {
+        //Check before draining, so nothing pushed before finish() was called can be missed
+        bool last = finishing;
+        SolutionRecord record;
+        bool received = false;
+        while (queue.tryPop(record)) {
+            int run_num = record.run_num;
+            pending[run_num] = std::move(record);
+            received = true;
+        }
+        bool wrote = writePending();
+        if (last) break;
+        if (received || wrote) {
+            idle = 0;
+        }
+        else if (++idle < 64) {
+            std::this_thread::yield();
+        }
+        else {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+}
+
+bool SolutionWriter::writePending() {
+    bool wrote = false;
+    while (!pending.empty() && (pending.begin()->first == next_run)) {
+        std::ostringstream rows;
+        std::ostringstream gate_rows;
+        std::ostringstream messages;
+        for (int count = 0; (count < k_WriteBatch) && !pending.empty() && (pending.begin()->first == next_run); ++count) {
+            const SolutionRecord& solution = pending.begin()->second;
+            Simulation::writeSolution(rows, solution);
+            if (write_gates) Simulation::writeGates(gate_rows, solution);
+            messages << "Run " << solution.run_num << ": Simulation ended at " << solution.time << " secs\n";
+            {
+                std::lock_guard<std::mutex> lock(statistics_mutex);
+                statistics.add(solution.run_num, StatisticsNode::fromSolution(solution));
+            }
+            pending.erase(pending.begin());
+            ++next_run;
+            ++written;
+        }
+        solutionfile << rows.str();
+        if (write_gates) gatesfile << gate_rows.str();
+        std::cout << messages.str();
+        wrote = true;
+    }
+    if (wrote) {
+        solutionfile.flush();
+        if (write_gates) gatesfile.flush();
+        std::cout.flush();
+    }
+    return wrote;
+}
+} // namespace trajectorysim
@@ -0,0 +1,86 @@
+#pragma once
+#include "MpscQueue.h"
+#include "Simulation.h"
+#include "Statistics.h"
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace trajectorysim {
+
+// Writes completed runs to [prefix]solution.csv from a dedicated thread, so simulation threads never wait on I/O.
+// Workers push records into a bounded lock-free queue and carry on. The writer drains the queue, puts records back
+// into run order, and formats and writes them in batches. Workers only wait if the queue fills, when the writer
+// has fallen behind. Records waiting on an earlier run are held at most k_ReorderWindow runs ahead of the next one
+// to be written: workers with runs further ahead wait for the order to catch up, which bounds the writer's memory.
+// As the writer sees every run in order, it also reduces the campaign's statistics.
+// If gates are recorded, each run's gate crossings are written to [prefix]gates.csv, also in run order.
+class SolutionWriter
+{
+public:
+    // Number of runs, from the next to be written, whose records can be held waiting for it. Runs must be dealt out so
+    // that whoever holds the next run never waits, such as in order within blocks of this many runs
+    static const int k_ReorderWindow = 16384;
+
+    // firstRun and endRun are the range of run numbers to be written, [firstRun, endRun). Records are written in run order
+    // writeGates also writes each record's gate crossings
+    // queueCapacity is the number of records that can be queued before workers have to wait for the writer
+    SolutionWriter(std::string fileprefix, int firstRun, int endRun, bool writeGates = false, size_t queueCapacity = 4096);
+    ~SolutionWriter();
+
+    // Opens [prefix]solution.csv, and [prefix]gates.csv if written, for appending, writing the column headings of new
+    // files, and starts the writer thread
+    void start();
+
+    // Queues a run's results to be written, first waiting until the run is within the reorder window. Returns without
+    // queueing if the cancel flag is set while waiting. Safe to call from any number of threads
+    void push(SolutionRecord record);
+
+    // Returns true if run_num is within the reorder window, so push() won't wait for it
+    bool accepts(int run_num);
+
+    // Stops push() waiting when cancel is set, as no earlier run will arrive
+    void setCancelFlag(const std::atomic<bool>* cancel);
+
+    // Waits for the writer to write every queued record that continues the run order, then stops it. Records left
+    // waiting on an earlier run that never arrived, such as after an error, are discarded
+    void finish();
+
+    // Returns the number of records written
+    int getWrittenCount();
+
+    // Returns the statistics of the runs written so far. Safe to call from any thread
+    StatisticsNode getStatistics();
+
+    // Returns the statistics of the runs written as aligned blocks, to be merged with those of other run ranges.
+    // Must only be called once finish() has returned
+    std::vector<StatisticsBlock> getStatisticsBlocks();
+
+private:
+    // Writer thread loop
+    void writerLoop();
+
+    // Writes the records that continue the run order from pending, in batches. Returns true if any were written
+    bool writePending();
+
+    std::string fileprefix;
+    std::ofstream solutionfile;
+    bool write_gates;
+    std::ofstream gatesfile;
+    MpscQueue<SolutionRecord> queue;
+    std::map<int, SolutionRecord> pending;
+    // Next run to be written. Read by workers to check the reorder window
+    std::atomic<int> next_run;
+    const std::atomic<bool>* cancel;
+    // Guards statistics, which is read by other threads while the writer adds to it
+    std::mutex statistics_mutex;
+    RangeStatistics statistics;
+    std::atomic<int> written;
+    std::atomic<bool> finishing;
+    std::thread writer;
+};
+} // namespace trajectorysim
@@ -0,0 +1,228 @@
+#include "stdafx.h"
+#include "Statistics.h"
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <string>
+
+namespace trajectorysim {
+
+static const char* k_VarNames[StatisticsNode::k_Vars] = { "pos_x", "pos_y", "pos_z", "tot time" };
+
+StatisticsNode StatisticsNode::empty() {
+    StatisticsNode node;
+    node.n = 0;
+    for (int i = 0; i < k_Vars; ++i) {
+        node.mean[i] = 0;
+        for (int j = 0; j < k_Vars; ++j) node.M2[i][j] = 0;
+    }
+    return node;
+}
+
+StatisticsNode StatisticsNode::fromSolution(const SolutionRecord& solution) {
+    StatisticsNode node = empty();
+    if (solution.status != k_Impact) return node;
+    node.n = 1;
+    node.mean[0] = solution.pos.x;
+    node.mean[1] = solution.pos.y;
+    node.mean[2] = solution.pos.z;
+    node.mean[3] = solution.time;
+    return node;
+}
+
+StatisticsNode StatisticsNode::combine(const StatisticsNode& lhs, const StatisticsNode& rhs) {
+    if (rhs.n == 0) return lhs;
+    if (lhs.n == 0) return rhs;
+
+    StatisticsNode node;
+    node.n = lhs.n + rhs.n;
+    double rhs_weight = (double)rhs.n / node.n;
+    double cross_weight = (double)lhs.n * rhs.n / node.n;
+    double delta[k_Vars];
+    for (int i = 0; i < k_Vars; ++i) {
+        delta[i] = rhs.mean[i] - lhs.mean[i];
+        node.mean[i] = lhs.mean[i] + delta[i] * rhs_weight;
+    }
+    for (int i = 0; i < k_Vars; ++i) {
+        for (int j = 0; j < k_Vars; ++j) {
+            node.M2[i][j] = lhs.M2[i][j] + rhs.M2[i][j] + delta[i] * delta[j] * cross_weight;
+        }
+    }
+    return node;
+}
+
+double StatisticsNode::getCovariance(int row, int col) const {
+    if (n < 2) return 0;
+    return M2[row][col] / (n - 1);
+}
+
+double StatisticsNode::getStdDev(int var) const {
+    return sqrt(getCovariance(var, var));
+}
+
+void StatisticsNode::write(std::ostream& out) const {
+    //Full precision, so identical statistics print identically
+    out << std::setprecision(std::numeric_limits<double>::max_digits10);
+    out << "statistic";
+    for (int i = 0; i < k_Vars; ++i) out << ", " << k_VarNames[i];
+    out << "\n";
+    out << "runs";
+    for (int i = 0; i < k_Vars; ++i) out << "," << n;
+    out << "\n";
+    out << "mean";
+    for (int i = 0; i < k_Vars; ++i) out << "," << mean[i];
+    out << "\n";
+    out << "stddev";
+    for (int i = 0; i < k_Vars; ++i) out << "," << getStdDev(i);
+    out << "\n";
+    for (int i = 0; i < k_Vars; ++i) {
+        out << "cov " << k_VarNames[i];
+        for (int j = 0; j < k_Vars; ++j) out << "," << getCovariance(i, j);
+        out << "\n";
+    }
+}
+
+void StatisticsBlock::write(std::ostream& out, const std::vector<StatisticsBlock>& blocks) {
+    out << "level, start, runs";
+    for (int i = 0; i < StatisticsNode::k_Vars; ++i) out << ", mean " << k_VarNames[i];
+    for (int i = 0; i < StatisticsNode::k_Vars; ++i) {
+        for (int j = 0; j < StatisticsNode::k_Vars; ++j) out << ", M2 " << k_VarNames[i] << " " << k_VarNames[j];
+    }
+    out << "\n";
+    out << std::hexfloat;
+    for (const StatisticsBlock& block : blocks) {
+        out << block.level << "," << block.start << "," << block.node.n;
+        for (int i = 0; i < StatisticsNode::k_Vars; ++i) out << "," << block.node.mean[i];
+        for (int i = 0; i < StatisticsNode::k_Vars; ++i) {
+            for (int j = 0; j < StatisticsNode::k_Vars; ++j) out << "," << block.node.M2[i][j];
+        }
+        out << "\n";
+    }
+    out << std::defaultfloat;
+}
+
+bool StatisticsBlock::read(std::istream& in, std::vector<StatisticsBlock>& blocks) {
+    const int fieldCount = 3 + StatisticsNode::k_Vars + StatisticsNode::k_Vars * StatisticsNode::k_Vars;
+    std::string line;
+    if (!std::getline(in, line)) return false;
+    while (std::getline(in, line)) {
+        if (line.empty() || line == "\r") continue;
+        //strtod reads hexadecimal floating point exactly, which stream extraction doesn't reliably do
+        std::vector<std::string> fields;
+        std::stringstream lineStream(line);
+        std::string field;
+        while (std::getline(lineStream, field, ',')) fields.push_back(field);
+        if ((int)fields.size() != fieldCount) return false;
+
+        StatisticsBlock block;
+        block.level = std::atoi(fields[0].c_str());
+        block.start = std::strtoll(fields[1].c_str(), nullptr, 10);
+        block.node.n = std::strtoll(fields[2].c_str(), nullptr, 10);
+        if ((block.level < 0) || (block.level > 62) || (block.start < 0) || ((block.start & (((int64_t)1 << block.level) - 1)) != 0)) {
+            return false;
+        }
+        int field_num = 3;
+        for (int i = 0; i < StatisticsNode::k_Vars; ++i) block.node.mean[i] = std::strtod(fields[field_num++].c_str(), nullptr);
+        for (int i = 0; i < StatisticsNode::k_Vars; ++i) {
+            for (int j = 0; j < StatisticsNode::k_Vars; ++j) block.node.M2[i][j] = std::strtod(fields[field_num++].c_str(), nullptr);
+        }
+        blocks.push_back(block);
+    }
+    return true;
+}
+
+StatisticsTree::StatisticsTree() {}
+
+void StatisticsTree::add(int level, int64_t start, const StatisticsNode& node) {
+    flush(start);
+    complete(level, start, node);
+}
+
+void StatisticsTree::complete(int level, int64_t start, StatisticsNode node) {
+    for (;;) {
+        if (level >= (int)slots.size()) slots.resize(level + 1, Slot{ false, 0, StatisticsNode::empty() });
+        int64_t size = (int64_t)1 << level;
+        if ((start & size) == 0) {
+            //Left child. Keep it until its sibling arrives, or until runs arrive beyond its parent
+            slots[level] = Slot{ true, start, node };
+            return;
+        }
+        //Right child, so the parent is finished. Its left child is either waiting, or had no runs
+        int64_t sibling = start - size;
+        if (slots[level].used && (slots[level].start == sibling)) {
+            node = StatisticsNode::combine(slots[level].node, node);
+            slots[level].used = false;
+        }
+        start = sibling;
+        ++level;
+    }
+}
+
+void StatisticsTree::flush(int64_t next) {
+    for (size_t level = 0; level < slots.size(); ++level) {
+        Slot& slot = slots[level];
+        if (slot.used && ((slot.start >> (level + 1)) != (next >> (level + 1)))) {
+            //The right sibling lies before next, so no runs were added to it
+            slot.used = false;
+            complete((int)level + 1, slot.start, slot.node);
+        }
+    }
+}
+
+StatisticsNode StatisticsTree::finalize() const {
+    //Every stored node is the left sibling of a subtree holding the nodes stored below it, so combine upwards,
+    //treating the runs still to come as missing
+    StatisticsNode root = StatisticsNode::empty();
+    for (const Slot& slot : slots) {
+        if (slot.used) root = StatisticsNode::combine(slot.node, root);
+    }
+    return root;
+}
+
+void StatisticsTree::clear() {
+    slots.clear();
+}
+
+RangeStatistics::RangeStatistics(int64_t start, int64_t end) {
+    //Take the largest aligned block that starts at each point and fits in the range
+    int64_t block_start = start;
+    while (block_start < end) {
+        int level = 0;
+        while ((level < 62) && ((block_start & (((int64_t)2 << level) - 1)) == 0) && (block_start + ((int64_t)2 << level) <= end)) {
+            ++level;
+        }
+        blocks.push_back(StatisticsBlock{ level, block_start, StatisticsNode::empty() });
+        block_start += (int64_t)1 << level;
+    }
+    current = 0;
+}
+
+void RangeStatistics::add(int64_t run, const StatisticsNode& node) {
+    while ((current < blocks.size()) && (run >= blocks[current].start + ((int64_t)1 << blocks[current].level))) {
+        blocks[current].node = tree.finalize();
+        tree.clear();
+        ++current;
+    }
+    tree.add(0, run, node);
+}
+
+std::vector<StatisticsBlock> RangeStatistics::getBlocks() const {
+    std::vector<StatisticsBlock> result;
+    //Blocks without impacts are kept, so the blocks tile the runs added. Empty nodes leave combine()'s result unchanged
+    for (size_t i = 0; (i < current) && (i < blocks.size()); ++i) result.push_back(blocks[i]);
+    if (current < blocks.size()) {
+        StatisticsBlock block = blocks[current];
+        block.node = tree.finalize();
+        result.push_back(block);
+    }
+    return result;
+}
+
+StatisticsNode RangeStatistics::finalize() const {
+    StatisticsTree blockTree;
+    for (const StatisticsBlock& block : getBlocks()) blockTree.add(block.level, block.start, block.node);
+    return blockTree.finalize();
+}
+} // namespace trajectorysim
@@ -0,0 +1,114 @@
+#pragma once
+#include "Simulation.h"
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace trajectorysim {
+
+// Running statistics of a set of runs: count, mean and covariance of the impact position (ECEF x, y, z) and time
+struct StatisticsNode {
+    static const int k_Vars = 4;
+
+    long long n;
+    double mean[k_Vars];
+    // Sums of products of deviations from the mean, in row major order. Covariance is M2 / (n - 1)
+    double M2[k_Vars][k_Vars];
+
+    // Statistics of no runs. Combining with it leaves the other node unchanged, bit for bit
+    static StatisticsNode empty();
+
+    // Statistics of a single run. Empty if it didn't impact, as its end point is then meaningless
+    static StatisticsNode fromSolution(const SolutionRecord& solution);
+
+    // Statistics of the union of two disjoint sets of runs, using Chan et al.'s pairwise update. Floating-point
+    // results depend on the order nodes are combined in, which StatisticsTree fixes
+    static StatisticsNode combine(const StatisticsNode& lhs, const StatisticsNode& rhs);
+
+    double getStdDev(int var) const;
+    double getCovariance(int row, int col) const;
+
+    // Writes the count, means, standard deviations and covariance matrix as csv
+    void write(std::ostream& out) const;
+};
+
+// Statistics of an aligned block of 2^level runs starting at run start. Blocks are whole subtrees of a
+// StatisticsTree, so blocks reduced separately, even by different processes, can be added to one tree to give
+// the same result as reducing all their runs together
+struct StatisticsBlock {
+    int level;
+    int64_t start;
+    StatisticsNode node;
+
+    // Writes blocks as csv, with values in hexadecimal floating point so they are read back exactly
+    static void write(std::ostream& out, const std::vector<StatisticsBlock>& blocks);
+
+    // Reads blocks written by write(), appending them to blocks. Returns false if the input is not in that format
+    static bool read(std::istream& in, std::vector<StatisticsBlock>& blocks);
+};
+
+// Reduces the statistics of runs over a fixed binary tree keyed by run number: leaf i holds run i, and each node
+// combines the aligned blocks of runs below it, with missing runs treated as empty. The result depends only on
+// which runs were added, never on thread count, scheduling or the order blocks finished in, so a seeded campaign
+// gives bit-identical statistics on any number of threads.
+// Blocks must be added in increasing run order. Only the left children still waiting on their right sibling are
+// kept, one per level, so memory is O(log runs).
+class StatisticsTree
+{
+public:
+    StatisticsTree();
+
+    // Adds the statistics of the aligned block of 2^level runs starting at run start, which must be a multiple of
+    // 2^level and after every block added before it. A single run is a block of level 0
+    void add(int level, int64_t start, const StatisticsNode& node);
+
+    // Returns the statistics of every run added, as combined at the root of the tree
+    StatisticsNode finalize() const;
+
+    // Removes all runs
+    void clear();
+
+private:
+    // A finished node waiting for its right sibling
+    struct Slot {
+        bool used;
+        int64_t start;
+        StatisticsNode node;
+    };
+
+    // Passes a finished node up the tree, combining it with its left sibling if it is a right child,
+    // otherwise storing it until its sibling arrives
+    void complete(int level, int64_t start, StatisticsNode node);
+
+    // Finishes every stored node whose parent cannot receive any runs from before next onwards
+    void flush(int64_t next);
+
+    std::vector<Slot> slots;
+};
+
+// Reduces the statistics of the runs in the range [start, end) into the largest aligned blocks that cover it,
+// so campaigns split into ranges can be merged with the same result as running the whole campaign at once
+class RangeStatistics
+{
+public:
+    RangeStatistics(int64_t start, int64_t end);
+
+    // Adds a run's statistics. Runs must be added in increasing run order, and lie within the range
+    void add(int64_t run, const StatisticsNode& node);
+
+    // Returns the blocks covering the runs added so far, including those without impacts. Runs missing from a block
+    // are treated as empty
+    std::vector<StatisticsBlock> getBlocks() const;
+
+    // Returns the statistics of every run added
+    StatisticsNode finalize() const;
+
+private:
+    // Aligned blocks covering the range, in run order
+    std::vector<StatisticsBlock> blocks;
+    // Block currently receiving runs, and its tree
+    size_t current;
+    StatisticsTree tree;
+};
+} // namespace trajectorysim
@@ -0,0 +1,81 @@
+#include "stdafx.h"
+#include "TimestepCalibration.h"
+#include "Simulation.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+
+namespace trajectorysim {
+
+//Range the observed order of convergence is clamped to. The lower bound keeps the estimate conservative when
+//successive differences don't shrink, and the upper bound when they happen to cancel
+static const double k_MinOrder = 1;
+static const double k_MaxOrder = 4;
+
+CalibrationLevel TimestepCalibration::runLevel(const Earth& earth, const RunCase& runCase, const IntegratorSettings& integrator, const ForceSettings& forces, const RunLimits& limits, double dT) {
+    std::unique_ptr<Projectile> projectile = Campaign::makeProjectile(runCase);
+    Simulation sim(earth, projectile.get(), dT, false, runCase.run_num);
+    sim.setIntegrator(integrator);
+    sim.setForces(forces);
+    sim.setRunLimits(limits);
+    sim.run();
+    SolutionRecord solution = sim.getSolution();
+    return CalibrationLevel{ dT, solution.steps, solution.status, solution.pos, solution.time, -1, -1 };
+}
+
+static double getDistance(const CalibrationLevel& lhs, const CalibrationLevel& rhs) {
+    return sqrt(pow(lhs.impact.x - rhs.impact.x, 2) + pow(lhs.impact.y - rhs.impact.y, 2) + pow(lhs.impact.z - rhs.impact.z, 2));
+}
+
+CalibrationResult TimestepCalibration::calibrate(const Earth& earth, const RunCase& runCase, const IntegratorSettings& integrator, const ForceSettings& forces, const RunLimits& limits, double maxDT, double tolerance, int maxHalvings) {
+    CalibrationResult result{ maxDT, -1, -1, false, k_Impact, {} };
+    double dT = maxDT;
+    for (int i = 0; i <= maxHalvings; ++i) {
+        result.levels.push_back(runLevel(earth, runCase, integrator, forces, limits.scaledTo(dT, maxDT), dT));
+        dT /= 2;
+        if (result.levels.back().status != k_Impact) {
+            //No impact to compare, so no finer level can be estimated either
+            result.stop_status = result.levels.back().status;
+            break;
+        }
+        if (result.levels.size() < 3) continue;
+
+        //Estimate the error of the level two halvings back, from its difference to the next level, and the order
+        //those differences converge at
+        size_t k = result.levels.size() - 3;
+        CalibrationLevel& level = result.levels[k];
+        const CalibrationLevel& half = result.levels[k + 1];
+        const CalibrationLevel& quarter = result.levels[k + 2];
+        double difference = getDistance(level, half);
+        double next_difference = getDistance(half, quarter);
+        double order = next_difference > 0 ? log2(difference / next_difference) : k_MaxOrder;
+        order = std::min(std::max(order, k_MinOrder), k_MaxOrder);
+        double richardson = pow(2, order) / (pow(2, order) - 1);
+        level.impact_error = difference * richardson;
+        level.time_error = fabs(level.time - half.time) * richardson;
+
+        result.dT = level.dT;
+        result.impact_error = level.impact_error;
+        result.time_error = level.time_error;
+        if (level.impact_error <= tolerance) {
+            result.met = true;
+            break;
+        }
+    }
+    return result;
+}
+
+void TimestepCalibration::write(std::ostream& out, const CalibrationResult& result) {
+    out << "dT, steps, pos_x, pos_y, pos_z, tot time, impact error est, time error est, status" << std::endl;
+    out << std::setprecision(9);
+    for (const CalibrationLevel& level : result.levels) {
+        out << level.dT << "," << level.steps << ",";
+        if (level.status == k_Impact) out << level.impact.x << "," << level.impact.y << "," << level.impact.z << "," << level.time << ",";
+        else out << ",,,,";
+        if (level.impact_error >= 0) out << level.impact_error << "," << level.time_error;
+        else out << ",";
+        out << "," << Simulation::getStatusName(level.status) << "\n";
+    }
+}
+} // namespace trajectorysim
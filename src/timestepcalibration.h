@@ -0,0 +1,56 @@
+#pragma once
+#include "Campaign.h"
+#include "Earth.h"
+#include "Forces.h"
+#include "Integrators.h"
+#include "Simulation.h"
+#include <ostream>
+#include <vector>
+
+namespace trajectorysim {
+
+// Impact of a single run at one of the calibration's dT
+struct CalibrationLevel {
+    double dT;
+    int steps;
+    // How the run ended. Anything but k_Impact stopped before reaching the ground, so has no impact
+    RunStatus status;
+    Earth::Coords impact;
+    double time;
+    // Estimated discretization error of the impact point, in m, and time, in secs. Negative until the finer levels
+    // needed to estimate it have been run
+    double impact_error;
+    double time_error;
+};
+
+// dT chosen by calibration, and its error estimate
+struct CalibrationResult {
+    double dT;
+    double impact_error;
+    double time_error;
+    // False if no dT tried met the tolerance, in which case dT is the finest tried with an error estimate
+    bool met;
+    // How the level that stopped the halvings ended, if it stopped before reaching the ground. k_Impact otherwise
+    RunStatus stop_status;
+    std::vector<CalibrationLevel> levels;
+};
+
+// Chooses dT for a campaign by running a single case at successively halved dT. The difference between the impacts
+// at dT and dT/2 is scaled to an error estimate by Richardson extrapolation, using the order of convergence observed
+// over the next halving, as the integrator's nominal order isn't reached across the drag coefficient's step at Mach 1
+class TimestepCalibration
+{
+public:
+    // Returns the largest of maxDT, maxDT/2, maxDT/4... whose impact point is estimated to be within tolerance m of
+    // the converged impact point, running runCase with the fixed-step integrator. limits are those of a run at maxDT,
+    // and their step limit is scaled with dT for each level. Stops after maxHalvings, or once a level stops before
+    // impact, which is recorded in stop_status
+    static CalibrationResult calibrate(const Earth& earth, const RunCase& runCase, const IntegratorSettings& integrator, const ForceSettings& forces, const RunLimits& limits, double maxDT, double tolerance, int maxHalvings = 12);
+
+    // Writes the levels run as [prefix]calibration.csv
+    static void write(std::ostream& out, const CalibrationResult& result);
+
+private:
+    static CalibrationLevel runLevel(const Earth& earth, const RunCase& runCase, const IntegratorSettings& integrator, const ForceSettings& forces, const RunLimits& limits, double dT);
+};
+} // namespace trajectorysim
@@ -0,0 +1,96 @@
+#include "stdafx.h"
+#include "Topology.h"
+#include <thread>
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace trajectorysim {
+
+#if defined(__linux__)
+// Parses a kernel cpu list, such as "0-15,32-47"
+static std::vector<int> ParseCpuList(const std::string& list) {
+    std::vector<int> cores;
+    std::istringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty()) continue;
+        int index = range.find("-");
+        int first = std::stoi(range.substr(0, index));
+        int last = (index == -1) ? first : std::stoi(range.substr(index + 1));
+        for (int core = first; core <= last; ++core) cores.push_back(core);
+    }
+    return cores;
+}
+#endif
+
+Topology::Topology()
+{
+#if defined(_WIN32)
+    ULONG highestNode = 0;
+    if (GetNumaHighestNodeNumber(&highestNode)) {
+        for (USHORT node = 0; node <= highestNode; ++node) {
+            ULONGLONG mask = 0;
+            if (!GetNumaNodeProcessorMask((UCHAR)node, &mask)) continue;
+            std::vector<int> cores;
+            for (int core = 0; core < 64; ++core) {
+                if (mask & (1ULL << core)) cores.push_back(core);
+            }
+            if (!cores.empty()) node_cores.push_back(cores);
+        }
+    }
+#elif defined(__linux__)
+    for (int node = 0; ; ++node) {
+        std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!cpulist) break;
+        std::string list;
+        std::getline(cpulist, list);
+        try {
+            std::vector<int> cores = ParseCpuList(list);
+            if (!cores.empty()) node_cores.push_back(cores);
+        }
+        catch (...) {
+            node_cores.clear();
+            break;
+        }
+    }
+#endif
+    if (node_cores.empty()) {
+        int threads = std::thread::hardware_concurrency();
+        if (threads <= 0) threads = 1;
+        node_cores.push_back(std::vector<int>());
+        for (int core = 0; core < threads; ++core) node_cores[0].push_back(core);
+    }
+}
+
+int Topology::getNodeCount() { return (int)node_cores.size(); }
+
+int Topology::getWorkerNode(int worker) {
+    return worker % node_cores.size();
+}
+
+int Topology::getWorkerCore(int worker) {
+    const std::vector<int>& cores = node_cores[getWorkerNode(worker)];
+    return cores[(worker / node_cores.size()) % cores.size()];
+}
+
+bool Topology::pinThread(int core) {
+#if defined(_WIN32)
+    if (core >= 64) return false;
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) != 0;
+#elif defined(__linux__)
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(core, &cpuset);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) == 0;
+#else
+    return false;
+#endif
+}
+} // namespace trajectorysim
@@ -0,0 +1,29 @@
+#pragma once
+#include <vector>
+
+namespace trajectorysim {
+
+// NUMA layout of the machine, used to place campaign workers. Detected from /sys on Linux and from the NUMA API on
+// Windows. Elsewhere, or if detection fails, the machine is treated as a single node holding every hardware thread.
+class Topology
+{
+public:
+    Topology();
+
+    // Returns the number of NUMA nodes
+    int getNodeCount();
+
+    // Returns the node worker should run on. Workers are spread round-robin over the nodes
+    int getWorkerNode(int worker);
+
+    // Returns the logical core worker should be pinned to, on its node
+    int getWorkerCore(int worker);
+
+    // Pins the calling thread to a logical core. Returns false if pinning isn't supported or fails
+    static bool pinThread(int core);
+
+private:
+    // Logical cores on each node
+    std::vector<std::vector<int>> node_cores;
+};
+} // namespace trajectorysim